@@ -110,8 +110,8 @@ setup_gdt:
 
 /*
  * I put the kernel page tables right after the page directory,
- * using 4 of them to span 16 Mb of physical memory. People with
- * more than 16MB will have to expand this.
+ * using 4 of them to span 16 Mb of physical memory. Memory above
+ * that is mapped by mem_init(), with page tables it allocates.
  */
 .org 0x1000
 pg0:
@@ -195,6 +195,10 @@ ignore_int:
  * I've tried to show which constants to change by having
  * some kind of marker at them (search for "16Mb"), but I
  * won't guarantee that's all :-( )
+ *
+ * Update: mem_init() now maps the rest of memory (up to 1Gb,
+ * where user space starts) before anything else runs, so only
+ * the bootstrap mapping here is 16Mb.
  */
 .align 2
 setup_paging:
@@ -234,7 +238,7 @@ gdt_descr:
 idt:	.fill 256,8,0		# idt is uninitialized
 
 gdt:	.quad 0x0000000000000000	/* NULL descriptor */
-	.quad 0x00c09a0000000fff	/* 16Mb */
-	.quad 0x00c0920000000fff	/* 16Mb */
+	.quad 0x00c39a000000ffff	/* 1Gb */
+	.quad 0x00c392000000ffff	/* 1Gb */
 	.quad 0x0000000000000000	/* TEMPORARY - don't use */
 	.fill 252,8,0			/* space for LDT's and TSS's etc */
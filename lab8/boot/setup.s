@@ -45,6 +45,35 @@ start:
 	int	0x15
 	mov	[2],ax
 
+! Get the memory map (e820), as that is the only way to see more than
+! 64MB. Up to 16 entries of 20 bytes are stored at 0x900A0, and their
+! number at 0x901E0. If the bios doesn't know e820 the count stays 0,
+! and main.c makes do with the extended memory size above.
+
+	mov	ax,#INITSEG
+	mov	es,ax
+	xor	al,al
+	mov	[0x1e0],al
+	xor	ebx,ebx		! continuation value, 0 to start
+	mov	di,#0x00a0
+e820_loop:
+	mov	eax,#0x0000e820
+	mov	edx,#0x534d4150	! 'SMAP'
+	mov	ecx,#20
+	int	0x15
+	jc	e820_done
+	cmp	eax,#0x534d4150
+	jne	e820_done
+	mov	al,[0x1e0]
+	inc	al
+	mov	[0x1e0],al
+	add	di,#20
+	cmp	di,#0x01e0
+	jae	e820_done
+	test	ebx,ebx		! 0 means that was the last entry
+	jnz	e820_loop
+e820_done:
+
 ! Get video-card data:
 
 	mov	ah,#0x0f
@@ -6,6 +6,7 @@
 
 /* bitmap.c contains the code that handles the inode and block bitmaps */
 #include <string.h>
+#include <sys/stat.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -44,6 +45,70 @@ __asm__ __volatile__ ("cld\n" \
 	:"=c" (__res):"c" (0),"S" (addr)); \
 __res;})
 
+/*
+ * Zones are numbered by their bit in the zone maps: bit 0 is the zone
+ * before the first data zone, which is never free.
+ */
+#define zone_bit(sb,block) ((block) - (sb)->s_firstdatazone + 1)
+#define zone_map(sb,bit) ((sb)->s_zmap[(bit)>>13]->b_data)
+#define nr_zone_bits(sb) ((sb)->s_nzones - (sb)->s_firstdatazone + 1)
+
+/*
+ * The super block keeps count of the clear bits in each map block and
+ * in all of them, so that nobody needs to count bits, and searches can
+ * skip map blocks that are full. The counts are made at mount time and
+ * kept up to date with every bit set or cleared.
+ */
+#define take_zone(sb,bit) ((sb)->s_zmap_free[(bit)>>13]--,(sb)->s_free_zones--)
+#define give_zone(sb,bit) ((sb)->s_zmap_free[(bit)>>13]++,(sb)->s_free_zones++)
+#define take_inode(sb,bit) ((sb)->s_imap_free[(bit)>>13]--,(sb)->s_free_inodes--)
+#define give_inode(sb,bit) ((sb)->s_imap_free[(bit)>>13]++,(sb)->s_free_inodes++)
+
+/*
+ * Counts the clear bits among the first 'nbits' of a map block, a word
+ * at a time.
+ */
+static int count_free(char * map, int nbits)
+{
+	unsigned long * p = (unsigned long *) map;
+	unsigned long w;
+	int free = 0;
+
+	for ( ; nbits > 0 ; nbits -= 32) {
+		w = ~*p++;
+		if (nbits < 32)
+			w &= (1UL << nbits) - 1;
+		w -= (w >> 1) & 0x55555555;
+		w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+		w = (w + (w >> 4)) & 0x0f0f0f0f;
+		free += (w * 0x01010101) >> 24;
+	}
+	return free;
+}
+
+void count_free_bits(struct super_block * sb)
+{
+	int i, n;
+
+	sb->s_free_inodes = sb->s_free_zones = 0;
+	for (i=0, n=sb->s_ninodes+1 ; i<I_MAP_SLOTS ; i++, n-=8192) {
+		sb->s_imap_free[i] = (n > 0 && sb->s_imap[i]) ?
+			count_free(sb->s_imap[i]->b_data,(n<8192)?n:8192) : 0;
+		sb->s_free_inodes += sb->s_imap_free[i];
+	}
+	for (i=0, n=nr_zone_bits(sb) ; i<Z_MAP_SLOTS ; i++, n-=8192) {
+		sb->s_zmap_free[i] = (n > 0 && sb->s_zmap[i]) ?
+			count_free(sb->s_zmap[i]->b_data,(n<8192)?n:8192) : 0;
+		sb->s_free_zones += sb->s_zmap_free[i];
+	}
+}
+
+/*
+ * The map buffers are held for good and changed in place. A change has
+ * to wait until a write of the buffer to its place is done, or it could
+ * get to the disk along with the committed maps, before it is committed
+ * itself. Nothing may sleep between the wait and the journal_dirty().
+ */
 void free_block(int dev, int block)
 {
 	struct super_block * sb;
@@ -55,6 +120,8 @@ void free_block(int dev, int block)
 		panic("trying to free block not in datazone");
 	bh = get_hash_table(dev,block);
 	if (bh) {
+		if (bh->b_jstate)
+			journal_forget(bh);
 		if (bh->b_count != 1) {
 			printk("trying to free block (%04x:%d), count=%d\n",
 				dev,block,bh->b_count);
@@ -65,43 +132,182 @@ void free_block(int dev, int block)
 		brelse(bh);
 	}
 	block -= sb->s_firstdatazone - 1 ;
+	wait_on_buffer(sb->s_zmap[block/8192]);
 	if (clear_bit(block&8191,sb->s_zmap[block/8192]->b_data)) {
 		printk("block (%04x:%d) ",dev,block+sb->s_firstdatazone-1);
 		panic("free_block: bit already cleared");
 	}
-	sb->s_zmap[block/8192]->b_dirt = 1;
+	give_zone(sb,block);
+	journal_dirty(sb->s_zmap[block/8192]);
 }
 
-int new_block(int dev)
+/*
+ * Finds the first free zone at or after bit 'start', wrapping around
+ * at the end of the device, a word at a time and skipping full map
+ * blocks. Returns -1 if there is none.
+ */
+static int find_free_zone(struct super_block * sb, int start)
+{
+	int nbits = nr_zone_bits(sb);
+	int bit, n, i;
+	unsigned long word;
+
+	if (!sb->s_free_zones)
+		return -1;
+	if (start < 1 || start >= nbits)
+		start = 1;
+	bit = start;
+	for (n = 0 ; n <= nbits ; ) {
+		if (!sb->s_zmap[bit>>13])
+			return -1;
+		if (!sb->s_zmap_free[bit>>13]) {
+			n += 8192 - (bit & 8191);
+			if ((bit = (bit | 8191) + 1) >= nbits)
+				bit = 0;
+			continue;
+		}
+		word = ((unsigned long *) zone_map(sb,bit))[(bit & 8191) >> 5];
+		word = ~word & (~0UL << (bit & 31));
+		if (word) {
+			__asm__("bsfl %1,%0":"=r" (i):"rm" (word));
+			if ((i += bit & ~31) < nbits)
+				return i;
+		}
+		n += 32 - (bit & 31);
+		if ((bit = (bit | 31) + 1) >= nbits)
+			bit = 0;
+	}
+	return -1;
+}
+
+/* gives a newly allocated block its buffer, cleared */
+static void clear_zone(int dev, int block)
 {
 	struct buffer_head * bh;
-	struct super_block * sb;
-	int i,j;
 
-	if (!(sb = get_super(dev)))
-		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if ((bh=sb->s_zmap[i]))
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (i>=8 || !bh || j>=8192)
-		return 0;
-	if (set_bit(j,bh->b_data))
-		panic("new_block: bit already set");
-	bh->b_dirt = 1;
-	j += i*8192 + sb->s_firstdatazone-1;
-	if (j >= sb->s_nzones)
-		return 0;
-	if (!(bh=getblk(dev,j)))
+	if (!(bh=getblk(dev,block)))
 		panic("new_block: cannot get block");
 	if (bh->b_count != 1)
 		panic("new block: count is != 1");
 	clear_block(bh->b_data);
 	bh->b_uptodate = 1;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
-	return j;
+}
+
+/*
+ * Allocates the first free block at or after 'goal', or, without a
+ * goal, after the block allocated last on the device: so the search
+ * doesn't start over from the beginning of the disk every time.
+ */
+static int alloc_block(int dev, int goal)
+{
+	struct super_block * sb;
+	int i;
+
+	if (!(sb = get_super(dev)))
+		panic("trying to get new block from nonexistant device");
+	if (goal >= sb->s_firstdatazone && goal < sb->s_nzones)
+		i = zone_bit(sb,goal);
+	else
+		i = sb->s_zsearch;
+repeat:
+	if ((i = find_free_zone(sb,i)) < 0)
+		return 0;
+	if (sb->s_zmap[i>>13]->b_lock) {
+		wait_on_buffer(sb->s_zmap[i>>13]);
+		goto repeat;
+	}
+	if (set_bit(i&8191,zone_map(sb,i)))
+		panic("new_block: bit already set");
+	take_zone(sb,i);
+	journal_dirty(sb->s_zmap[i>>13]);
+	sb->s_zsearch = i+1;
+	return i + sb->s_firstdatazone-1;
+}
+
+/* like alloc_block(), and the block gets a cleared buffer */
+int new_block(int dev, int goal)
+{
+	int block;
+
+	if ((block = alloc_block(dev,goal)))
+		clear_zone(dev,block);
+	return block;
+}
+
+/*
+ * A regular file also reserves the PREALLOC_BLOCKS-1 blocks after the
+ * one it gets, as far as they are free. They are marked in the zone
+ * map, so nobody else takes them, and handed out when the file asks
+ * for exactly the next one: appending goes on contiguously even with
+ * other files being written at the same time. discard_prealloc() gives
+ * back what is left when the inode is released or truncated.
+ *
+ * The block is only cleared in the buffer cache if 'clear' is set: file
+ * data goes through the page cache, where a new block reads as zero as
+ * long as it is past the end of the file or was a hole when the page
+ * was read. Clearing it here too would write it twice, and bdflush
+ * could write the zeroes over the data after a crash.
+ */
+#define PREALLOC_BLOCKS	8
+
+int new_file_block(struct m_inode * inode, int goal, int clear)
+{
+	struct super_block * sb;
+	int block, i;
+
+	if (inode->i_prealloc_count) {
+		if (goal == inode->i_prealloc_block) {
+			block = inode->i_prealloc_block++;
+			inode->i_prealloc_count--;
+			if (clear)
+				clear_zone(inode->i_dev,block);
+			return block;
+		}
+		discard_prealloc(inode);
+	}
+	if (!(block = alloc_block(inode->i_dev,goal)))
+		return 0;
+	if (clear)
+		clear_zone(inode->i_dev,block);
+	if (!S_ISREG(inode->i_mode))
+		return block;
+	sb = get_super(inode->i_dev);
+	for (i = zone_bit(sb,block)+1 ; i < nr_zone_bits(sb) &&
+	    inode->i_prealloc_count < PREALLOC_BLOCKS-1 ; i++) {
+		if (!sb->s_zmap[i>>13] || sb->s_zmap[i>>13]->b_lock ||
+		    set_bit(i&8191,zone_map(sb,i)))
+			break;
+		take_zone(sb,i);
+		journal_dirty(sb->s_zmap[i>>13]);
+		inode->i_prealloc_count++;
+	}
+	if (inode->i_prealloc_count) {
+		inode->i_prealloc_block = block+1;
+		sb->s_zsearch = i;
+	}
+	return block;
+}
+
+void discard_prealloc(struct m_inode * inode)
+{
+	struct super_block * sb;
+	int i;
+
+	if (!inode->i_prealloc_count)
+		return;
+	if (!(sb = get_super(inode->i_dev)))
+		panic("discard_prealloc: nonexistent device");
+	i = zone_bit(sb,inode->i_prealloc_block);
+	for ( ; inode->i_prealloc_count ; inode->i_prealloc_count--,i++) {
+		wait_on_buffer(sb->s_zmap[i>>13]);
+		if (clear_bit(i&8191,zone_map(sb,i)))
+			printk("discard_prealloc: bit already cleared\n\r");
+		else
+			give_zone(sb,i);
+		journal_dirty(sb->s_zmap[i>>13]);
+	}
 }
 
 void free_inode(struct m_inode * inode)
@@ -112,7 +318,7 @@ void free_inode(struct m_inode * inode)
 	if (!inode)
 		return;
 	if (!inode->i_dev) {
-		memset(inode,0,sizeof(*inode));
+		clear_inode(inode);
 		return;
 	}
 	if (inode->i_count>1) {
@@ -127,10 +333,13 @@ void free_inode(struct m_inode * inode)
 		panic("trying to free inode 0 or nonexistant inode");
 	if (!(bh=sb->s_imap[inode->i_num>>13]))
 		panic("nonexistent imap in superblock");
+	wait_on_buffer(bh);
 	if (clear_bit(inode->i_num&8191,bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
-	bh->b_dirt = 1;
-	memset(inode,0,sizeof(*inode));
+	else
+		give_inode(sb,inode->i_num);
+	journal_dirty(bh);
+	clear_inode(inode);
 }
 
 struct m_inode * new_inode(int dev)
@@ -144,18 +353,25 @@ struct m_inode * new_inode(int dev)
 		return NULL;
 	if (!(sb = get_super(dev)))
 		panic("new_inode with unknown device");
+repeat:
 	j = 8192;
+	bh = NULL;
 	for (i=0 ; i<8 ; i++)
-		if ((bh=sb->s_imap[i]))
+		if (sb->s_imap_free[i] && (bh=sb->s_imap[i]))
 			if ((j=find_first_zero(bh->b_data))<8192)
 				break;
 	if (!bh || j >= 8192 || j+i*8192 > sb->s_ninodes) {
 		iput(inode);
 		return NULL;
 	}
+	if (bh->b_lock) {
+		wait_on_buffer(bh);
+		goto repeat;
+	}
 	if (set_bit(j,bh->b_data))
 		panic("new_inode: bit already set");
-	bh->b_dirt = 1;
+	take_inode(sb,i*8192+j);
+	journal_dirty(bh);
 	inode->i_count=1;
 	inode->i_nlinks=1;
 	inode->i_dev=dev;
@@ -163,6 +379,7 @@ struct m_inode * new_inode(int dev)
 	inode->i_gid=current->egid;
 	inode->i_dirt=1;
 	inode->i_num = j + i*8192;
+	insert_inode_hash(inode);
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	return inode;
 }
@@ -36,9 +36,9 @@ int block_write(int dev, long * pos, char * buf, int count)
 		*pos += chars;
 		written += chars;
 		count -= chars;
-		while (chars-->0)
-			*(p++) = get_fs_byte(buf++);
-		bh->b_dirt = 1;
+		copy_from_user(p,buf,chars);
+		buf += chars;
+		mark_buffer_dirty(bh);
 		brelse(bh);
 	}
 	return written;
@@ -65,8 +65,8 @@ int block_read(int dev, unsigned long * pos, char * buf, int count)
 		*pos += chars;
 		read += chars;
 		count -= chars;
-		while (chars-->0)
-			put_fs_byte(*(p++),buf++);
+		copy_to_user(buf,p,chars);
+		buf += chars;
 		brelse(bh);
 	}
 	return read;
@@ -19,11 +19,13 @@
  */
 
 #include <stdarg.h>
+#include <errno.h>
  
 #include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
+#include <asm/segment.h>
 #include <asm/io.h>
 
 extern int end;
@@ -31,12 +33,63 @@ extern void put_super(int);
 extern void invalidate_inodes(int);
 
 struct buffer_head * start_buffer = (struct buffer_head *) &end;
-struct buffer_head * hash_table[NR_HASH];
-static struct buffer_head * free_list;
+struct buffer_head ** hash_table;
+int nr_hash = 0;
+static int hash_shift;
+unsigned long buffer_hits = 0, buffer_misses = 0, buffer_probes = 0;
+static struct buffer_head * lru_list[NR_LIST] = {NULL,};
+static int nr_buffers_type[NR_LIST] = {0,};
 static struct task_struct * buffer_wait = NULL;
 int NR_BUFFERS = 0;
 
-static inline void wait_on_buffer(struct buffer_head * bh)
+/* at most this many buffers are kept on BUF_USED */
+#define MAX_USED (NR_BUFFERS - NR_BUFFERS/4)
+
+/*
+ * Parameters of the flusher (see sys_bdflush), which can be read and
+ * changed with bdflush(2*n+2,&value) and bdflush(2*n+3,value).
+ */
+#define N_PARAM 4
+
+static union bdflush_param {
+	struct {
+		long nfract;	/* % of buffers dirty before we flush early */
+		long ndirty;	/* max buffers written per pass */
+		long age;	/* ticks a buffer may stay dirty */
+		long interval;	/* ticks between passes */
+	} b_un;
+	long data[N_PARAM];
+} bdf_prm = {{40, 256, 30*HZ, 5*HZ}};
+
+static long bdflush_min[N_PARAM] = {1, 16, HZ, HZ/10};
+static long bdflush_max[N_PARAM] = {100, 4096, 600*HZ, 60*HZ};
+
+#define TOO_MANY_DIRTY \
+	(nr_buffers_type[BUF_DIRTY] > NR_BUFFERS*bdf_prm.b_un.nfract/100)
+
+/* buffers written at once, by the flusher or by getblk() */
+#define FLUSH_BATCH 32
+
+static struct task_struct * bdflush_wait = NULL;
+static int bdflush_running = 0;
+static int bdflush_timer = 0;
+
+/*
+ * Dirty buffers are also on a dirty list, hashed by device and sorted by
+ * (device, block), so that syncing a device only looks at its dirty
+ * blocks, and writes them in order. mark_buffer_dirty() puts them there.
+ * Buffers that have been written are only taken off the list when it
+ * is next walked, or when the buffer is reused.
+ */
+#define NR_DIRTY_LISTS 16
+#define _dirty_hashfn(dev) (((unsigned)((dev)^((dev)>>8))) % NR_DIRTY_LISTS)
+#define dirty_list(dev) dirty_lists[_dirty_hashfn(dev)]
+
+static struct buffer_head * dirty_lists[NR_DIRTY_LISTS] = {NULL,};
+
+static void sync_buffers(int dev);
+
+void wait_on_buffer(struct buffer_head * bh)
 {
 	cli();
 	while (bh->b_lock)
@@ -46,41 +99,18 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 
 int sys_sync(void)
 {
-	int i;
-	struct buffer_head * bh;
-
+	sync_pages(0);		/* write out file data */
 	sync_inodes();		/* write out inodes into buffers */
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		wait_on_buffer(bh);
-		if (bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	journal_commit_all(0,0);
+	sync_buffers(0);
 	return 0;
 }
 
 int sync_dev(int dev)
 {
-	int i;
-	struct buffer_head * bh;
-
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	sync_buffers(dev);
 	sync_inodes();
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
-		if (bh->b_dev != dev)
-			continue;
-		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_dirt)
-			ll_rw_block(WRITE,bh);
-	}
+	sync_buffers(dev);
 	return 0;
 }
 
@@ -125,37 +155,32 @@ void check_disk_change(int dev)
 		if (super_block[i].s_dev == dev)
 			put_super(super_block[i].s_dev);
 	invalidate_inodes(dev);
+	invalidate_pages(dev);
 	invalidate_buffers(dev);
 }
 
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+/*
+ * nr_hash is a power of two, sized to the number of buffers. The hash
+ * multiplies (dev,block) by a number close to 2^32/phi and keeps the
+ * top bits, so that neighbouring blocks end up in unrelated chains.
+ */
+#define _hashfn(dev,block) \
+	(((((unsigned long)(dev)<<16) ^ (unsigned long)(block)) * \
+	0x9e370001UL) >> hash_shift)
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
-static inline void remove_from_queues(struct buffer_head * bh)
+static inline void remove_from_hash(struct buffer_head * bh)
 {
-/* remove from hash-queue */
 	if (bh->b_next)
 		bh->b_next->b_prev = bh->b_prev;
 	if (bh->b_prev)
 		bh->b_prev->b_next = bh->b_next;
 	if (hash(bh->b_dev,bh->b_blocknr) == bh)
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
-/* remove from free list */
-	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
 }
 
-static inline void insert_into_queues(struct buffer_head * bh)
+static inline void insert_into_hash(struct buffer_head * bh)
 {
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
 /* put the buffer in new hash-queue if it has a device */
 	bh->b_prev = NULL;
 	bh->b_next = NULL;
@@ -163,16 +188,219 @@ static inline void insert_into_queues(struct buffer_head * bh)
 		return;
 	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
 	hash(bh->b_dev,bh->b_blocknr) = bh;
-	bh->b_next->b_prev = bh;
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
+}
+
+/*
+ * Buffers that nobody is using (b_count == 0) are on one of the lru
+ * lists, oldest first:
+ *
+ *	BUF_CLEAN	clean, not used since they were read
+ *	BUF_USED	clean, and found in the cache again at least once
+ *	BUF_DIRTY	waiting to be written
+ *
+ * New blocks get the oldest BUF_CLEAN buffer, so reading through lots
+ * of blocks once only pushes out other blocks that were used once, not
+ * the meta-data that is used again and again. BUF_USED is kept to at
+ * most MAX_USED buffers by moving its oldest back to BUF_CLEAN.
+ *
+ * Buffers in use are on no list; b_list says where they go when
+ * released. Only process context touches the lists.
+ */
+static inline void remove_from_lru(struct buffer_head * bh)
+{
+	int list = bh->b_list;
+
+	if (!(bh->b_prev_free) || !(bh->b_next_free))
+		panic("Free block list corrupted");
+	bh->b_prev_free->b_next_free = bh->b_next_free;
+	bh->b_next_free->b_prev_free = bh->b_prev_free;
+	if (lru_list[list] == bh)
+		lru_list[list] = bh->b_next_free;
+	if (lru_list[list] == bh)
+		lru_list[list] = NULL;
+	bh->b_prev_free = bh->b_next_free = NULL;
+	nr_buffers_type[list]--;
+}
+
+static inline void add_to_lru(struct buffer_head * bh, int list)
+{
+	bh->b_list = list;
+	nr_buffers_type[list]++;
+	if (!lru_list[list]) {
+		lru_list[list] = bh->b_prev_free = bh->b_next_free = bh;
+		return;
+	}
+	bh->b_next_free = lru_list[list];
+	bh->b_prev_free = lru_list[list]->b_prev_free;
+	lru_list[list]->b_prev_free->b_next_free = bh;
+	lru_list[list]->b_prev_free = bh;
+}
+
+static inline void get_buffer(struct buffer_head * bh)
+{
+	if (!bh->b_count++)
+		remove_from_lru(bh);
+}
+
+/*
+ * Drops a reference without waiting for the buffer. The last one puts
+ * it at the end of its lru list.
+ */
+static void put_buffer(struct buffer_head * bh)
+{
+	if (--bh->b_count)
+		return;
+	if (bh->b_dirt) {
+		if (!bh->b_flushtime)
+			bh->b_flushtime = jiffies + bdf_prm.b_un.age;
+		add_to_lru(bh,BUF_DIRTY);
+		if (TOO_MANY_DIRTY)
+			wake_up(&bdflush_wait);
+		return;
+	}
+	bh->b_flushtime = 0;
+	if (bh->b_list == BUF_USED) {
+		add_to_lru(bh,BUF_USED);
+		if (nr_buffers_type[BUF_USED] > MAX_USED) {
+			bh = lru_list[BUF_USED];
+			remove_from_lru(bh);
+			add_to_lru(bh,BUF_CLEAN);
+		}
+	} else
+		add_to_lru(bh,BUF_CLEAN);
+}
+
+static void insert_dirty(struct buffer_head * bh)
+{
+	struct buffer_head * tmp, * prev = NULL;
+
+	for (tmp = dirty_list(bh->b_dev) ; tmp ; prev = tmp, tmp = tmp->b_next_dirty)
+		if (tmp->b_dev > bh->b_dev || (tmp->b_dev == bh->b_dev &&
+		    tmp->b_blocknr > bh->b_blocknr))
+			break;
+	bh->b_prev_dirty = prev;
+	bh->b_next_dirty = tmp;
+	if (tmp)
+		tmp->b_prev_dirty = bh;
+	if (prev)
+		prev->b_next_dirty = bh;
+	else
+		dirty_list(bh->b_dev) = bh;
+	bh->b_on_dirty = 1;
+}
+
+static void remove_dirty(struct buffer_head * bh)
+{
+	if (bh->b_next_dirty)
+		bh->b_next_dirty->b_prev_dirty = bh->b_prev_dirty;
+	if (bh->b_prev_dirty)
+		bh->b_prev_dirty->b_next_dirty = bh->b_next_dirty;
+	else
+		dirty_list(bh->b_dev) = bh->b_next_dirty;
+	bh->b_prev_dirty = bh->b_next_dirty = NULL;
+	bh->b_on_dirty = 0;
+}
+
+void mark_buffer_dirty(struct buffer_head * bh)
+{
+	bh->b_dirt = 1;
+	if (!bh->b_on_dirty)
+		insert_dirty(bh);
+}
+
+/*
+ * Writes the dirty buffers of dev (all devices if 0) in block order,
+ * dropping buffers that are clean and unused from the lists on the way.
+ * The buffer being written is held, so it stays on the list while we
+ * sleep, and we can go on from it.
+ */
+static void sync_buffers(int dev)
+{
+	struct buffer_head * bh, * next;
+	int i;
+
+	for (i = 0 ; i < NR_DIRTY_LISTS ; i++) {
+		if (dev && i != _dirty_hashfn(dev))
+			continue;
+		for (bh = dirty_lists[i] ; bh ; bh = next) {
+			next = bh->b_next_dirty;
+			if (dev && bh->b_dev != dev)
+				continue;
+			if (!bh->b_dirt) {
+				if (!bh->b_lock && !bh->b_count)
+					remove_dirty(bh);
+				continue;
+			}
+			get_buffer(bh);
+			ll_rw_block(WRITE,bh);
+			next = bh->b_next_dirty;
+			put_buffer(bh);
+		}
+	}
+}
+
+/*
+ * Like sync_buffers(dev), but waits until the blocks are on the disk.
+ */
+int fsync_dev(int dev)
+{
+	struct buffer_head * bh, * next;
+
+	sync_buffers(dev);
+	for (bh = dirty_list(dev) ; bh ; bh = next) {
+		next = bh->b_next_dirty;
+		if (bh->b_dev != dev || !bh->b_lock)
+			continue;
+		get_buffer(bh);
+		wait_on_buffer(bh);
+		next = bh->b_next_dirty;
+		put_buffer(bh);
+	}
+	return 0;
+}
+
+/*
+ * Finds an unused buffer to take for a new block: the oldest clean one,
+ * preferring BUF_CLEAN. Normally that is the head of the list. Dirty
+ * buffers that have been written since are moved to BUF_CLEAN first.
+ * Returns a locked buffer (to wait on) if that is all there is, and
+ * NULL if all unused buffers are dirty.
+ */
+static struct buffer_head * find_victim(void)
+{
+	struct buffer_head * bh, * locked = NULL;
+	int i, n;
+
+	while ((bh = lru_list[BUF_DIRTY]) && !bh->b_dirt && !bh->b_lock) {
+		remove_from_lru(bh);
+		bh->b_flushtime = 0;
+		add_to_lru(bh,BUF_CLEAN);
+	}
+	for (i = BUF_CLEAN ; i <= BUF_USED ; i++) {
+		bh = lru_list[i];
+		for (n = nr_buffers_type[i] ; n-- > 0 ; bh = bh->b_next_free) {
+			if (bh->b_dirt)
+				continue;
+			if (!bh->b_lock)
+				return bh;
+			if (!locked)
+				locked = bh;
+		}
+	}
+	return locked;
 }
 
 static struct buffer_head * find_buffer(int dev, int block)
 {		
 	struct buffer_head * tmp;
 
-	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next)
+	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next) {
+		buffer_probes++;
 		if (tmp->b_dev==dev && tmp->b_blocknr==block)
 			return tmp;
+	}
 	return NULL;
 }
 
@@ -188,14 +416,133 @@ struct buffer_head * get_hash_table(int dev, int block)
 	struct buffer_head * bh;
 
 	for (;;) {
-		if (!(bh=find_buffer(dev,block)))
+		if (!(bh=find_buffer(dev,block))) {
+			buffer_misses++;
 			return NULL;
-		bh->b_count++;
+		}
+		get_buffer(bh);
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_blocknr == block)
+		if (bh->b_dev == dev && bh->b_blocknr == block) {
+			buffer_hits++;
+			bh->b_list = BUF_USED;
 			return bh;
-		bh->b_count--;
+		}
+		put_buffer(bh);
+	}
+}
+
+/*
+ * Starts writing up to nr buffers off BUF_DIRTY, in (device, block)
+ * order so that the requests are close together. Unless "all" is set
+ * only those that have been dirty for long enough are taken. Returns
+ * the number of buffers written. If "first" isn't NULL, the first
+ * buffer of the batch is left held in it, for the caller to wait on.
+ */
+static int write_dirty_buffers(int nr, int all, struct buffer_head ** first)
+{
+	struct buffer_head * list[FLUSH_BATCH], * bh;
+	int i, j, n = 0;
+
+	if (nr > FLUSH_BATCH)
+		nr = FLUSH_BATCH;
+	bh = lru_list[BUF_DIRTY];
+	for (i = nr_buffers_type[BUF_DIRTY] ; i-- > 0 && n < nr ;
+	     bh = bh->b_next_free) {
+		if (!bh->b_dirt || bh->b_lock)
+			continue;
+		if (!all && bh->b_flushtime > jiffies)
+			continue;
+		list[n++] = bh;
+	}
+/* insertion sort - n is small */
+	for (i = 0 ; i < n ; i++) {
+		get_buffer(bh = list[i]);
+		for (j = i ; j > 0 ; j--) {
+			if (list[j-1]->b_dev < bh->b_dev)
+				break;
+			if (list[j-1]->b_dev == bh->b_dev &&
+			    list[j-1]->b_blocknr < bh->b_blocknr)
+				break;
+			list[j] = list[j-1];
+		}
+		list[j] = bh;
+	}
+	for (i = 0 ; i < n ; i++) {
+		ll_rw_block(WRITE,list[i]);
+		if (i || !first)
+			put_buffer(list[i]);
+	}
+	if (first)
+		*first = n ? list[0] : NULL;
+	if (n)
+		wake_up(&buffer_wait);
+	return n;
+}
+
+static void bdflush_timeout(void)
+{
+	bdflush_timer = 0;
+	wake_up(&bdflush_wait);
+}
+
+/*
+ * bdflush(1,0) doesn't return: the calling process (started by init)
+ * becomes the flusher, which writes back dirty buffers that are older
+ * than the age parameter every interval ticks, and starts early to
+ * write the oldest when more than nfract percent are dirty. That way
+ * getblk() normally finds clean buffers. File pages in the page cache
+ * that are older than age are written first (ndirty/4 of them at most,
+ * a page being 4 blocks), then journal transactions that have been
+ * running for an interval are committed.
+ */
+int sys_bdflush(int func, long data)
+{
+	int i, n;
+
+	if (func == 1) {
+		if (!suser())
+			return -EPERM;
+		if (bdflush_running)
+			return -EBUSY;
+		bdflush_running = 1;
+		for (;;) {
+			write_dirty_pages(bdf_prm.b_un.ndirty/4,bdf_prm.b_un.age);
+			journal_commit_all(0,bdf_prm.b_un.interval);
+			n = 0;
+			if (TOO_MANY_DIRTY)
+				while (n < bdf_prm.b_un.ndirty &&
+				    (i = write_dirty_buffers(FLUSH_BATCH,1,NULL)))
+					n += i;
+			while (n < bdf_prm.b_un.ndirty &&
+			    (i = write_dirty_buffers(FLUSH_BATCH,0,NULL)))
+				n += i;
+			if (n && TOO_MANY_DIRTY)
+				continue;
+			if (!bdflush_timer) {
+				bdflush_timer = 1;
+				add_timer(bdf_prm.b_un.interval,bdflush_timeout);
+			}
+			interruptible_sleep_on(&bdflush_wait);
+			if (current->signal & ~current->blocked) {
+				bdflush_running = 0;
+				return -EINTR;
+			}
+		}
+	}
+	i = (func-2) >> 1;
+	if (func < 2 || i >= N_PARAM)
+		return -EINVAL;
+	if (!(func & 1)) {
+		verify_area((void *) data,4);
+		put_fs_long(bdf_prm.data[i],(unsigned long *) data);
+		return 0;
 	}
+	if (!suser())
+		return -EPERM;
+	if (data < bdflush_min[i] || data > bdflush_max[i])
+		return -EINVAL;
+	bdf_prm.data[i] = data;
+	return 0;
 }
 
 /*
@@ -205,51 +552,48 @@ struct buffer_head * get_hash_table(int dev, int block)
  *
  * The algoritm is changed: hopefully better, and an elusive bug removed.
  */
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
 struct buffer_head * getblk(int dev,int block)
 {
-	struct buffer_head * tmp, * bh;
+	struct buffer_head * bh, * first;
 
 repeat:
 	if ((bh = get_hash_table(dev,block)))
 		return bh;
-	tmp = free_list;
-	do {
-		if (tmp->b_count)
-			continue;
-		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp))
-				break;
+	if (!(bh = find_victim())) {
+		if (!(bh = lru_list[BUF_DIRTY])) {
+			sleep_on(&buffer_wait);
+			goto repeat;
 		}
-/* and repeat until we find something good */
-	} while ((tmp = tmp->b_next_free) != free_list);
-	if (!bh) {
-		sleep_on(&buffer_wait);
+		wake_up(&bdflush_wait);
+		if (!write_dirty_buffers(FLUSH_BATCH,1,&first)) {
+			wait_on_buffer(bh);
+			goto repeat;
+		}
+/* the batch is sorted, so the first one is likely to be done first */
+		wait_on_buffer(first);
+		put_buffer(first);
 		goto repeat;
 	}
 	wait_on_buffer(bh);
-	if (bh->b_count)
+	if (bh->b_count || bh->b_dirt)
 		goto repeat;
-	while (bh->b_dirt) {
-		sync_dev(bh->b_dev);
-		wait_on_buffer(bh);
-		if (bh->b_count)
-			goto repeat;
-	}
 /* NOTE!! While we slept waiting for this block, somebody else might */
 /* already have added "this" block to the cache. check it */
 	if (find_buffer(dev,block))
 		goto repeat;
 /* OK, FINALLY we know that this buffer is the only one of it's kind, */
 /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
+	remove_from_lru(bh);
+	if (bh->b_on_dirty)
+		remove_dirty(bh);
 	bh->b_count=1;
 	bh->b_dirt=0;
 	bh->b_uptodate=0;
-	remove_from_queues(bh);
+	bh->b_list=BUF_CLEAN;
+	remove_from_hash(bh);
 	bh->b_dev=dev;
 	bh->b_blocknr=block;
-	insert_into_queues(bh);
+	insert_into_hash(bh);
 	return bh;
 }
 
@@ -258,8 +602,9 @@ void brelse(struct buffer_head * buf)
 	if (!buf)
 		return;
 	wait_on_buffer(buf);
-	if (!(buf->b_count--))
+	if (!buf->b_count)
 		panic("Trying to free free buffer");
+	put_buffer(buf);
 	wake_up(&buffer_wait);
 }
 
@@ -317,6 +662,87 @@ void bread_page(unsigned long address,int dev,int b[4])
 		}
 }
 
+/*
+ * brw_page_start starts reading or writing the four blocks of a page cache
+ * page directly, without going through the buffer cache: "tmp" points to
+ * four buffer heads that the caller keeps until brw_page_wait. A copy of
+ * a block that does exist in the buffer cache wins on reads, and is
+ * forgotten on writes, so that it can't later overwrite the data on disk.
+ */
+void brw_page_start(int rw, struct buffer_head * tmp, unsigned long address,
+	int dev, int b[4])
+{
+	struct buffer_head * bh;
+	int i;
+
+	for (i=0 ; i<4 ; i++,tmp++) {
+		tmp->b_dev = 0;
+		if (!b[i])
+			continue;
+		if ((bh = get_hash_table(dev,b[i]))) {
+			if (rw == READ && bh->b_uptodate) {
+				COPYBLK((unsigned long) bh->b_data,
+					address + i*BLOCK_SIZE);
+/* the page has it now: let this copy go first */
+				bh->b_list = BUF_CLEAN;
+				brelse(bh);
+				continue;
+			}
+			if (rw == WRITE)
+				bh->b_uptodate = bh->b_dirt = 0;
+			brelse(bh);
+		}
+		tmp->b_data = (char *) address + i*BLOCK_SIZE;
+		tmp->b_blocknr = b[i];
+		tmp->b_dev = dev;
+		tmp->b_uptodate = (rw == WRITE);
+		tmp->b_dirt = (rw == WRITE);
+		tmp->b_count = 1;
+		tmp->b_lock = 0;
+		tmp->b_wait = NULL;
+		ll_rw_block(rw,tmp);
+	}
+}
+
+/*
+ * Waits for the I/O started by brw_page_start. Returns 0 if a read failed.
+ */
+int brw_page_wait(struct buffer_head * tmp)
+{
+	int i, ok = 1;
+
+	for (i=0 ; i<4 ; i++,tmp++)
+		if (tmp->b_dev) {
+			wait_on_buffer(tmp);
+			if (!tmp->b_uptodate)
+				ok = 0;
+		}
+	return ok;
+}
+
+int brw_page(int rw, unsigned long address, int dev, int b[4])
+{
+	struct buffer_head tmp[4];
+
+	brw_page_start(rw,tmp,address,dev,b);
+	return brw_page_wait(tmp);
+}
+
+/*
+ * Starts reading a block into the buffer cache, but doesn't wait for it.
+ * As this is READA, nothing happens if the request queue is full.
+ */
+void readahead_block(int dev, int block)
+{
+	struct buffer_head * bh;
+
+	if (!(bh = getblk(dev,block)))
+		return;
+	if (!bh->b_uptodate)
+		ll_rw_block(READA,bh);
+	put_buffer(bh);
+}
+
 /*
  * Ok, breada can be used as bread, but additionally to mark other
  * blocks for reading as well. End the argument list with a negative
@@ -325,21 +751,15 @@ void bread_page(unsigned long address,int dev,int b[4])
 struct buffer_head * breada(int dev,int first, ...)
 {
 	va_list args;
-	struct buffer_head * bh, *tmp;
+	struct buffer_head * bh;
 
 	va_start(args,first);
 	if (!(bh=getblk(dev,first)))
 		panic("bread: getblk returned NULL\n");
 	if (!bh->b_uptodate)
 		ll_rw_block(READ,bh);
-	while ((first=va_arg(args,int))>=0) {
-		tmp=getblk(dev,first);
-		if (tmp) {
-			if (!tmp->b_uptodate)
-				ll_rw_block(READA,bh);
-			tmp->b_count--;
-		}
-	}
+	while ((first=va_arg(args,int))>=0)
+		readahead_block(dev,first);
 	va_end(args);
 	wait_on_buffer(bh);
 	if (bh->b_uptodate)
@@ -358,6 +778,13 @@ void buffer_init(long buffer_end)
 		b = (void *) (640*1024);
 	else
 		b = (void *) buffer_end;
+/* about one hash chain per buffer - the table goes at the top */
+	i = (b - (void *) h) / (BLOCK_SIZE + sizeof(struct buffer_head));
+	for (nr_hash = 16, hash_shift = 28 ; nr_hash < i ; nr_hash <<= 1)
+		hash_shift--;
+	b -= (nr_hash * sizeof(struct buffer_head *) + BLOCK_SIZE-1) &
+		~(BLOCK_SIZE-1);
+	hash_table = (struct buffer_head **) b;
 	while ( (b -= BLOCK_SIZE) >= ((void *) (h+1)) ) {
 		h->b_dev = 0;
 		h->b_dirt = 0;
@@ -368,17 +795,19 @@ void buffer_init(long buffer_end)
 		h->b_next = NULL;
 		h->b_prev = NULL;
 		h->b_data = (char *) b;
-		h->b_prev_free = h-1;
-		h->b_next_free = h+1;
+		h->b_on_dirty = 0;
+		h->b_flushtime = 0;
+		h->b_prev_dirty = NULL;
+		h->b_next_dirty = NULL;
+		h->b_jstate = 0;
+		h->b_jseq = 0;
+		h->b_jnext = NULL;
+		add_to_lru(h,BUF_CLEAN);
 		h++;
 		NR_BUFFERS++;
 		if (b == (void *) 0x100000)
 			b = (void *) 0xA0000;
 	}
-	h--;
-	free_list = start_buffer;
-	free_list->b_prev_free = h;
-	h->b_next_free = free_list;
-	for (i=0;i<NR_HASH;i++)
+	for (i=0;i<nr_hash;i++)
 		hash_table[i]=NULL;
 }	
@@ -0,0 +1,204 @@
+/*
+ *  linux/fs/dcache.c
+ */
+
+/*
+ * The directory-entry cache remembers what path lookup found: for a
+ * (device, directory, name) the inode number, or that there is no such
+ * name (a negative entry). Names come from user space, like everything
+ * namei.c handles, and are truncated to NAME_LEN the way find_entry()
+ * does it.
+ *
+ * Anything that changes a directory drops the entries it makes wrong
+ * and bumps dcache_seq: a lookup that slept in find_entry() only adds
+ * what it found if nothing changed meanwhile.
+ *
+ * ".." is never cached, as find_entry() has to do its magic for it.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+#define NR_DENTRY	256
+#define NR_DHASH	64
+
+struct dentry {
+	unsigned short d_dev;
+	unsigned short d_dir;
+	unsigned short d_ino;		/* 0 for a negative entry */
+	unsigned short d_len;		/* 0 if the entry is unused */
+	char d_name[NAME_LEN];
+	struct dentry * d_next;		/* hash chain */
+	struct dentry * d_prev;
+	struct dentry * d_next_lru;	/* circular, oldest first */
+	struct dentry * d_prev_lru;
+};
+
+static struct dentry dentry_table[NR_DENTRY];
+static struct dentry * dentry_hash[NR_DHASH];
+static struct dentry * lru_head = NULL;
+
+unsigned long dcache_seq = 0;
+
+static void dcache_init(void)
+{
+	int i;
+
+	for (i = 0 ; i < NR_DENTRY ; i++) {
+		dentry_table[i].d_next_lru = dentry_table + (i+1) % NR_DENTRY;
+		dentry_table[i].d_prev_lru =
+			dentry_table + (i+NR_DENTRY-1) % NR_DENTRY;
+	}
+	lru_head = dentry_table;
+}
+
+/*
+ * Copies the name in, returning its length, or 0 if it is not to be
+ * cached.
+ */
+static int get_name(const char * name, int len, char * buf)
+{
+	int i;
+
+	if (len > NAME_LEN)
+		len = NAME_LEN;
+	for (i = 0 ; i < len ; i++)
+		buf[i] = get_fs_byte(name+i);
+	if (len == 2 && buf[0] == '.' && buf[1] == '.')
+		return 0;
+	return len;
+}
+
+static int hashfn(int dev, int dir, const char * name, int len)
+{
+	unsigned long hash = (dev << 16) ^ dir;
+
+	while (len--)
+		hash = hash * 31 + *(unsigned char *) name++;
+	return hash % NR_DHASH;
+}
+
+static struct dentry * find_dentry(int dev, int dir, const char * name,
+	int len)
+{
+	struct dentry * d;
+	int i;
+
+	for (d = dentry_hash[hashfn(dev,dir,name,len)] ; d ; d = d->d_next) {
+		if (d->d_dev != dev || d->d_dir != dir || d->d_len != len)
+			continue;
+		for (i = 0 ; i < len && d->d_name[i] == name[i] ; i++)
+			/* nothing */;
+		if (i == len)
+			return d;
+	}
+	return NULL;
+}
+
+static void remove_dentry(struct dentry * d)
+{
+	if (d->d_next)
+		d->d_next->d_prev = d->d_prev;
+	if (d->d_prev)
+		d->d_prev->d_next = d->d_next;
+	else
+		dentry_hash[hashfn(d->d_dev,d->d_dir,d->d_name,d->d_len)] =
+			d->d_next;
+	d->d_next = d->d_prev = NULL;
+	d->d_len = 0;
+}
+
+/* makes 'd' the most recently used entry */
+static void touch_dentry(struct dentry * d)
+{
+	if (d == lru_head) {
+		lru_head = d->d_next_lru;
+		return;
+	}
+	d->d_prev_lru->d_next_lru = d->d_next_lru;
+	d->d_next_lru->d_prev_lru = d->d_prev_lru;
+	d->d_next_lru = lru_head;
+	d->d_prev_lru = lru_head->d_prev_lru;
+	lru_head->d_prev_lru->d_next_lru = d;
+	lru_head->d_prev_lru = d;
+}
+
+/*
+ * Returns the inode number of the name, -1 if the name is known not to
+ * exist, and 0 if the cache doesn't know.
+ */
+int dcache_lookup(struct m_inode * dir, const char * name, int len)
+{
+	char buf[NAME_LEN];
+	struct dentry * d;
+
+	if (!(len = get_name(name,len,buf)))
+		return 0;
+	if (!(d = find_dentry(dir->i_dev,dir->i_num,buf,len)))
+		return 0;
+	touch_dentry(d);
+	return d->d_ino ? d->d_ino : -1;
+}
+
+/*
+ * Remembers what a lookup found (ino 0 for nothing), if dcache_seq is
+ * still what it was when the lookup started.
+ */
+void dcache_add(struct m_inode * dir, const char * name, int len, int ino,
+	unsigned long seq)
+{
+	char buf[NAME_LEN];
+	struct dentry * d;
+	int i;
+
+	if (seq != dcache_seq || !(len = get_name(name,len,buf)))
+		return;
+	if ((d = find_dentry(dir->i_dev,dir->i_num,buf,len))) {
+		d->d_ino = ino;
+		touch_dentry(d);
+		return;
+	}
+	if (!lru_head)
+		dcache_init();
+	d = lru_head;
+	if (d->d_len)
+		remove_dentry(d);
+	d->d_dev = dir->i_dev;
+	d->d_dir = dir->i_num;
+	d->d_ino = ino;
+	d->d_len = len;
+	for (i = 0 ; i < len ; i++)
+		d->d_name[i] = buf[i];
+	i = hashfn(d->d_dev,d->d_dir,d->d_name,len);
+	if ((d->d_next = dentry_hash[i]))
+		d->d_next->d_prev = d;
+	dentry_hash[i] = d;
+	touch_dentry(d);
+}
+
+/* a name in 'dir' has been added or removed */
+void dcache_invalidate(struct m_inode * dir, const char * name, int len)
+{
+	char buf[NAME_LEN];
+	struct dentry * d;
+
+	dcache_seq++;
+	if ((len = get_name(name,len,buf)) &&
+	    (d = find_dentry(dir->i_dev,dir->i_num,buf,len)))
+		remove_dentry(d);
+}
+
+/*
+ * Drops the entries of a directory that is going away (dir != 0), or of
+ * a whole device that is unmounted (dir == 0).
+ */
+void dcache_purge(int dev, int dir)
+{
+	struct dentry * d;
+
+	dcache_seq++;
+	for (d = dentry_table ; d < dentry_table + NR_DENTRY ; d++)
+		if (d->d_len && d->d_dev == dev && (!dir || d->d_dir == dir))
+			remove_dentry(d);
+}
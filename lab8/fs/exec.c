@@ -158,7 +158,7 @@ static unsigned long change_ldt(unsigned long text_size,unsigned long * page)
 
 	code_limit = text_size+PAGE_SIZE -1;
 	code_limit &= 0xFFFFF000;
-	data_limit = 0x4000000;
+	data_limit = TASK_SIZE;
 	code_base = get_base(current->ldt[1]);
 	data_base = code_base;
 	set_base(current->ldt[1],code_base);
@@ -183,7 +183,7 @@ int do_execve(unsigned long * eip,long tmp,char * filename,
 	char ** argv, char ** envp)
 {
 	struct m_inode * inode;
-	struct buffer_head * bh;
+	unsigned long head;
 	struct exec ex;
 	unsigned long page[MAX_ARG_PAGES];
 	int i,argc,envc;
@@ -218,12 +218,12 @@ restart_interp:
 		retval = -ENOEXEC;
 		goto exec_error2;
 	}
-	if (!(bh = bread(inode->i_dev,inode->i_zone[0]))) {
+	if (!(head = read_cache_page(inode,0))) {
 		retval = -EACCES;
 		goto exec_error2;
 	}
-	ex = *((struct exec *) bh->b_data);	/* read exec-header */
-	if ((bh->b_data[0] == '#') && (bh->b_data[1] == '!') && (!sh_bang)) {
+	ex = *((struct exec *) head);	/* read exec-header */
+	if ((((char *) head)[0] == '#') && (((char *) head)[1] == '!') && (!sh_bang)) {
 		/*
 		 * This section does the #! interpretation.
 		 * Sorta complicated, but hopefully it will work.  -TYT
@@ -232,8 +232,8 @@ restart_interp:
 		char buf[1023], *cp, *interp, *i_name, *i_arg;
 		unsigned long old_fs;
 
-		strncpy(buf, bh->b_data+2, 1022);
-		brelse(bh);
+		strncpy(buf, (char *) head+2, 1022);
+		free_page(head);
 		iput(inode);
 		buf[1022] = '\0';
 		if ((cp = strchr(buf, '\n'))) {
@@ -295,9 +295,9 @@ restart_interp:
 		set_fs(old_fs);
 		goto restart_interp;
 	}
-	brelse(bh);
+	free_page(head);
 	if (N_MAGIC(ex) != ZMAGIC || ex.a_trsize || ex.a_drsize ||
-		ex.a_text+ex.a_data+ex.a_bss>0x3000000 ||
+		ex.a_text+ex.a_data+ex.a_bss>MMAP_TOP ||
 		inode->i_size < ex.a_text+ex.a_data+ex.a_syms+N_TXTOFF(ex)) {
 		retval = -ENOEXEC;
 		goto exec_error2;
@@ -325,8 +325,9 @@ restart_interp:
 		if ((current->close_on_exec>>i)&1)
 			sys_close(i);
 	current->close_on_exec = 0;
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	exit_mmap();
+	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f),current);
+	free_page_tables(get_base(current->ldt[2]),get_limit(0x17),current);
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
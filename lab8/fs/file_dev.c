@@ -6,6 +6,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -14,7 +15,11 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
-int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
+/*
+ * Directories are meta-data, and are changed through the buffer cache by
+ * namei.c, so they are read from there too.
+ */
+static int dir_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
 	int left,chars,nr;
 	struct buffer_head * bh;
@@ -32,27 +37,121 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 		filp->f_pos += chars;
 		left -= chars;
 		if (bh) {
-			char * p = nr + bh->b_data;
-			while (chars-->0)
-				put_fs_byte(*(p++),buf++);
+			copy_to_user(buf,nr + bh->b_data,chars);
 			brelse(bh);
-		} else {
-			while (chars-->0)
-				put_fs_byte(0,buf++);
-		}
+		} else
+			clear_user(buf,chars);
+		buf += chars;
 	}
 	inode->i_atime = CURRENT_TIME;
 	return (count-left)?(count-left):-ERROR;
 }
 
+/*
+ * Readahead: a read that starts where the last one on this file ended
+ * is taken to be sequential, and opens (or doubles, up to MAX_READAHEAD)
+ * a window of blocks ahead of the file position. Any other read closes
+ * it. The blocks are only queued as READA requests into the buffer
+ * cache, nobody waits for them: the page cache copies them from there
+ * when the reader gets that far.
+ */
+#define MIN_READAHEAD 4
+#define MAX_READAHEAD 32
+
+static void file_readahead(struct m_inode * inode, struct file * filp)
+{
+	unsigned long block, end;
+	int nr;
+
+	block = (filp->f_pos + BLOCK_SIZE-1) >> BLOCK_SIZE_BITS;
+	end = block + filp->f_ra_blocks;
+	if (end > (inode->i_size + BLOCK_SIZE-1) >> BLOCK_SIZE_BITS)
+		end = (inode->i_size + BLOCK_SIZE-1) >> BLOCK_SIZE_BITS;
+	if (block < filp->f_ra_next)
+		block = filp->f_ra_next;
+	for ( ; block < end ; block++) {
+		if (page_cached(inode,block << BLOCK_SIZE_BITS))
+			continue;
+		if ((nr = bmap(inode,block)))
+			readahead_block(inode->i_dev,nr);
+	}
+	if (block > filp->f_ra_next)
+		filp->f_ra_next = block;
+}
+
+/*
+ * generic_file_read() walks the page cache from filp->f_pos and hands
+ * each piece to 'actor', which returns how much of it it used (or an
+ * error). file_read()'s actor copies to user space, sendfile() has one
+ * that writes the page cache data straight to another file.
+ */
+int generic_file_read(struct m_inode * inode, struct file * filp, int count,
+	read_actor_t actor, void * desc)
+{
+	int left,chars,nr,error = -ERROR;
+	unsigned long page;
+
+	if ((left=count)<=0)
+		return 0;
+	if (filp->f_pos != filp->f_ra_prev) {
+		filp->f_ra_blocks = 0;
+		filp->f_ra_next = 0;
+	} else if (!filp->f_ra_blocks)
+		filp->f_ra_blocks = MIN_READAHEAD;
+	else if ((filp->f_ra_blocks <<= 1) > MAX_READAHEAD)
+		filp->f_ra_blocks = MAX_READAHEAD;
+	while (left) {
+		if (!(page = read_cache_page(inode,filp->f_pos & ~(PAGE_SIZE-1))))
+			break;
+		nr = filp->f_pos & (PAGE_SIZE-1);
+		chars = MIN( PAGE_SIZE-nr , left );
+		nr = actor(desc,nr + (char *) page,chars);
+		free_page(page);
+		if (nr < 0) {
+			error = nr;
+			break;
+		}
+		filp->f_pos += nr;
+		left -= nr;
+		if (nr < chars)
+			break;
+	}
+	filp->f_ra_prev = filp->f_pos;
+	if (filp->f_ra_blocks)
+		file_readahead(inode,filp);
+	inode->i_atime = CURRENT_TIME;
+	return (count-left)?(count-left):error;
+}
+
+static int file_read_actor(void * desc, char * from, int count)
+{
+	copy_to_user(*(char **) desc,from,count);
+	*(char **) desc += count;
+	return count;
+}
+
+int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
+{
+	if (!S_ISREG(inode->i_mode))
+		return dir_read(inode,filp,buf,count);
+	return generic_file_read(inode,filp,count,file_read_actor,&buf);
+}
+
+/*
+ * Writes go to the page cache. The blocks are allocated right away, so
+ * that a full disk is noticed here, but the data is only written out
+ * later - see mm/filemap.c.
+ */
 int file_write(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
 	off_t pos;
-	int block,c;
-	struct buffer_head * bh;
+	int c;
+	unsigned long page;
 	char * p;
 	int i=0;
 
+	if (journal_busy(inode))
+		return -ETXTBSY;
 /*
  * ok, append may not work when many processes are writing at the same time
  * but so what. That way leads to madness anyway.
@@ -62,14 +161,23 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 	else
 		pos = filp->f_pos;
 	while (i<count) {
-		if (!(block = create_block(inode,pos/BLOCK_SIZE)))
+/*
+ * The page is read before its blocks are allocated, so that new blocks
+ * read as zero: they aren't cleared on the disk. Blocks for later pages
+ * are only allocated ahead when they are past the end of the file.
+ */
+		if (!(page = read_cache_page(inode,pos & ~(PAGE_SIZE-1))))
 			break;
-		if (!(bh=bread(inode->i_dev,block)))
+		c = count-i;
+		if (pos < inode->i_size && c > PAGE_SIZE - (pos & (PAGE_SIZE-1)))
+			c = PAGE_SIZE - (pos & (PAGE_SIZE-1));
+		if (!create_blocks(inode,pos/BLOCK_SIZE,
+		    (pos%BLOCK_SIZE + c + BLOCK_SIZE-1)/BLOCK_SIZE)) {
+			free_page(page);
 			break;
-		c = pos % BLOCK_SIZE;
-		p = c + bh->b_data;
-		bh->b_dirt = 1;
-		c = BLOCK_SIZE-c;
+		}
+		p = (pos & (PAGE_SIZE-1)) + (char *) page;
+		c = BLOCK_SIZE - pos % BLOCK_SIZE;
 		if (c > count-i) c = count-i;
 		pos += c;
 		if (pos > inode->i_size) {
@@ -77,10 +185,12 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 			inode->i_dirt = 1;
 		}
 		i += c;
-		while (c-->0)
-			*(p++) = get_fs_byte(buf++);
-		brelse(bh);
+		copy_from_user(p,buf,c);
+		buf += c;
+		mark_page_dirty(page,inode);
+		free_page(page);
 	}
+	balance_dirty_pages();
 	inode->i_mtime = CURRENT_TIME;
 	if (!(filp->f_flags & O_APPEND)) {
 		filp->f_pos = pos;
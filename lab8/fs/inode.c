@@ -12,7 +12,21 @@
 #include <linux/mm.h>
 #include <asm/system.h>
 
-struct m_inode inode_table[NR_INODE]={{0,},};
+/*
+ * In-memory inodes are allocated a page at a time, and never freed. All
+ * of them are on the first_inode list; those with a device are hashed
+ * on (dev, nr), and those not in use (i_count == 0) are on the free
+ * list, least recently used first. An inode is reused only when there
+ * are NR_INODE of them, or when no page can be had for more.
+ */
+struct m_inode * first_inode = NULL;
+int nr_inodes = 0;
+
+static struct m_inode * inode_hash[NR_IHASH];
+static struct m_inode * free_inodes = NULL;
+
+#define _ihashfn(dev,nr) (((unsigned)((dev)^(nr)))%NR_IHASH)
+#define ihash(dev,nr) inode_hash[_ihashfn(dev,nr)]
 
 static void read_inode(struct m_inode * inode);
 static void write_inode(struct m_inode * inode);
@@ -40,17 +54,105 @@ static inline void unlock_inode(struct m_inode * inode)
 	wake_up(&inode->i_wait);
 }
 
-void invalidate_inodes(int dev)
+static void remove_free(struct m_inode * inode)
+{
+	if (inode->i_free_next == inode)
+		free_inodes = NULL;
+	else {
+		inode->i_free_prev->i_free_next = inode->i_free_next;
+		inode->i_free_next->i_free_prev = inode->i_free_prev;
+		if (free_inodes == inode)
+			free_inodes = inode->i_free_next;
+	}
+	inode->i_free_next = inode->i_free_prev = NULL;
+}
+
+/*
+ * An inode whose contents are worth keeping goes last, one with nothing
+ * in it first.
+ */
+static void put_free(struct m_inode * inode, int last)
+{
+	if (!free_inodes) {
+		inode->i_free_next = inode->i_free_prev = inode;
+		free_inodes = inode;
+		return;
+	}
+	inode->i_free_next = free_inodes;
+	inode->i_free_prev = free_inodes->i_free_prev;
+	free_inodes->i_free_prev->i_free_next = inode;
+	free_inodes->i_free_prev = inode;
+	if (!last)
+		free_inodes = inode;
+}
+
+static void remove_hash(struct m_inode * inode)
+{
+	if (inode->i_hash_next)
+		inode->i_hash_next->i_hash_prev = inode->i_hash_prev;
+	if (inode->i_hash_prev)
+		inode->i_hash_prev->i_hash_next = inode->i_hash_next;
+	else if (ihash(inode->i_dev,inode->i_num) == inode)
+		ihash(inode->i_dev,inode->i_num) = inode->i_hash_next;
+	inode->i_hash_next = inode->i_hash_prev = NULL;
+}
+
+void insert_inode_hash(struct m_inode * inode)
+{
+	if ((inode->i_hash_next = ihash(inode->i_dev,inode->i_num)))
+		inode->i_hash_next->i_hash_prev = inode;
+	inode->i_hash_prev = NULL;
+	ihash(inode->i_dev,inode->i_num) = inode;
+}
+
+static struct m_inode * find_inode(int dev, int nr)
+{
+	struct m_inode * inode;
+
+	for (inode = ihash(dev,nr) ; inode ; inode = inode->i_hash_next)
+		if (inode->i_dev == dev && inode->i_num == nr)
+			return inode;
+	return NULL;
+}
+
+/*
+ * Forgets what the inode was, keeping it on the lists. An inode that
+ * was in use becomes free.
+ */
+void clear_inode(struct m_inode * inode)
+{
+	if (inode->i_dev)
+		remove_hash(inode);
+	if (inode->i_count)
+		put_free(inode,0);
+	memset(inode,0,(char *) &inode->i_next - (char *) inode);
+}
+
+static void grow_inodes(void)
 {
+	struct m_inode * inode;
 	int i;
+
+	if (!(inode = (struct m_inode *) get_free_page()))
+		return;
+	for (i = PAGE_SIZE/sizeof(struct m_inode) ; i ; i--,inode++) {
+		inode->i_next = first_inode;
+		first_inode = inode;
+		put_free(inode,0);
+		nr_inodes++;
+	}
+}
+
+void invalidate_inodes(int dev)
+{
 	struct m_inode * inode;
 
-	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
+	for (inode = first_inode ; inode ; inode = inode->i_next) {
 		wait_on_inode(inode);
 		if (inode->i_dev == dev) {
 			if (inode->i_count)
 				printk("inode in use on removed disk\n\r");
+			remove_hash(inode);
 			inode->i_dev = inode->i_dirt = 0;
 		}
 	}
@@ -58,83 +160,154 @@ void invalidate_inodes(int dev)
 
 void sync_inodes(void)
 {
-	int i;
 	struct m_inode * inode;
 
-	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
+	for (inode = first_inode ; inode ; inode = inode->i_next) {
 		wait_on_inode(inode);
 		if (inode->i_dirt && !inode->i_pipe)
 			write_inode(inode);
 	}
 }
 
+static int _bmap(struct m_inode * inode,int block,int create);
+
+/*
+ * Gets a new block for block 'nr' of the file, or for an indirect block
+ * on the way to it. It should go right after block nr-1, so that files
+ * that are written in order are laid out in order. Only indirect blocks
+ * and directory blocks are cleared: file data is in the page cache.
+ */
+#define clear_data(inode) (!S_ISREG((inode)->i_mode))
+
+static int new_zone(struct m_inode * inode, int nr, int clear)
+{
+	int goal = 0;
+
+	if (nr > 0 && (goal = _bmap(inode,nr-1,0)))
+		goal++;
+	return new_file_block(inode,goal,clear);
+}
+
+/*
+ * A zone array is either the direct zones of the inode (bh == NULL) or
+ * an indirect block.
+ */
+static inline unsigned long get_entry(struct super_block * sb,
+	struct m_inode * inode, struct buffer_head * bh, int i)
+{
+	if (!bh)
+		return inode->i_zone[i];
+	return ind_zone(sb,bh->b_data,i);
+}
+
+static inline void set_entry(struct super_block * sb,
+	struct m_inode * inode, struct buffer_head * bh, int i, int zone)
+{
+	if (!bh) {
+		inode->i_zone[i] = zone;
+		inode->i_ctime = CURRENT_TIME;
+		inode->i_dirt = 1;
+	} else if (sb->s_version == MINIX_V2) {
+		((unsigned long *) (bh->b_data))[i] = zone;
+		journal_dirty(bh);
+	} else {
+		((unsigned short *) (bh->b_data))[i] = zone;
+		journal_dirty(bh);
+	}
+}
+
+/*
+ * The last extent _bmap() found is cached in the inode: file blocks
+ * from i_ext_block on are the zones from i_ext_zone on, for i_ext_len
+ * blocks. It is found by looking along the zone array the block was
+ * mapped in, so a file laid out contiguously costs one walk down the
+ * indirect blocks per 256 or 512 blocks, not one per block. Zones are
+ * only ever taken away from a file by truncate(), which drops it.
+ *
+ * map_zones() maps entry 'i' of a zone array of 'end' entries, which
+ * is file block 'nr', allocating the first 'create' missing entries
+ * from there on: file_write() gets a whole cluster of blocks mapped in
+ * one go, as far as they are in the same array. The buffer is released.
+ */
+static int map_zones(struct m_inode * inode, struct super_block * sb,
+	struct buffer_head * bh, int i, int end, int nr, int create)
+{
+	unsigned long zone, prev = 0;
+	int j;
+
+	if (create > end-i)
+		create = end-i;
+	for (j = i ; j < i+create ; j++) {
+		if (!(zone = get_entry(sb,inode,bh,j))) {
+			if (prev)
+				zone = new_file_block(inode,prev+1,
+					clear_data(inode));
+			else
+				zone = new_zone(inode,nr+j-i,clear_data(inode));
+			if (!zone)
+				break;
+			set_entry(sb,inode,bh,j,zone);
+		}
+		prev = zone;
+	}
+	if ((zone = get_entry(sb,inode,bh,i))) {
+		for (j = i+1 ; j < end && get_entry(sb,inode,bh,j) == zone+j-i ; j++)
+			/* nothing */;
+		inode->i_ext_block = nr;
+		inode->i_ext_zone = zone;
+		inode->i_ext_len = j-i;
+	}
+	brelse(bh);
+	return zone;
+}
+
+/*
+ * After the 7 direct zones come a single, a double and (on v2 only) a
+ * triple indirect zone. An indirect block holds 1<<ZONE_BITS(sb) zone
+ * numbers: 512 16-bit ones on v1, 256 32-bit ones on v2.
+ */
 static int _bmap(struct m_inode * inode,int block,int create)
 {
+	struct super_block * sb;
 	struct buffer_head * bh;
-	int i;
+	int i, depth, bits, shift, nr = block;
+	unsigned long zone;
 
 	if (block<0)
 		panic("_bmap: block<0");
-	if (block >= 7+512+512*512)
-		panic("_bmap: block>big");
-	if (block<7) {
-		if (create && !inode->i_zone[block])
-			if ((inode->i_zone[block]=new_block(inode->i_dev))) {
-				inode->i_ctime=CURRENT_TIME;
-				inode->i_dirt=1;
-			}
-		return inode->i_zone[block];
-	}
+	if (inode->i_ext_len && block >= inode->i_ext_block &&
+	    block < inode->i_ext_block + inode->i_ext_len)
+		return inode->i_ext_zone + (block - inode->i_ext_block);
+	if (block<7)
+		return map_zones(inode,NULL,NULL,block,7,nr,create);
+	if (!(sb = get_super(inode->i_dev)))
+		panic("_bmap: no super block");
+	bits = ZONE_BITS(sb);
 	block -= 7;
-	if (block<512) {
-		if (create && !inode->i_zone[7])
-			if ((inode->i_zone[7]=new_block(inode->i_dev))) {
-				inode->i_dirt=1;
-				inode->i_ctime=CURRENT_TIME;
-			}
-		if (!inode->i_zone[7])
-			return 0;
-		if (!(bh = bread(inode->i_dev,inode->i_zone[7])))
-			return 0;
-		i = ((unsigned short *) (bh->b_data))[block];
-		if (create && !i)
-			if ((i=new_block(inode->i_dev))) {
-				((unsigned short *) (bh->b_data))[block]=i;
-				bh->b_dirt=1;
-			}
-		brelse(bh);
-		return i;
+	for (depth = 1 ; block >= 1 << (bits*depth) ; depth++) {
+		block -= 1 << (bits*depth);
+		if (depth >= (sb->s_version == MINIX_V2 ? 3 : 2))
+			panic("_bmap: block>big");
 	}
-	block -= 512;
-	if (create && !inode->i_zone[8])
-		if ((inode->i_zone[8]=new_block(inode->i_dev))) {
+	if (create && !inode->i_zone[6+depth])
+		if ((inode->i_zone[6+depth]=new_zone(inode,nr,1))) {
 			inode->i_dirt=1;
 			inode->i_ctime=CURRENT_TIME;
 		}
-	if (!inode->i_zone[8])
-		return 0;
-	if (!(bh=bread(inode->i_dev,inode->i_zone[8])))
-		return 0;
-	i = ((unsigned short *)bh->b_data)[block>>9];
-	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block>>9]=i;
-			bh->b_dirt=1;
-		}
-	brelse(bh);
-	if (!i)
-		return 0;
-	if (!(bh=bread(inode->i_dev,i)))
-		return 0;
-	i = ((unsigned short *)bh->b_data)[block&511];
-	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block&511]=i;
-			bh->b_dirt=1;
-		}
-	brelse(bh);
-	return i;
+	zone = inode->i_zone[6+depth];
+	for (shift = bits*(depth-1) ; zone ; shift -= bits) {
+		if (!(bh=bread(inode->i_dev,zone)))
+			return 0;
+		i = (block >> shift) & ((1 << bits)-1);
+		if (!shift)
+			return map_zones(inode,sb,bh,i,1 << bits,nr,create);
+		zone = ind_zone(sb,bh->b_data,i);
+		if (create && !zone)
+			if ((zone=new_zone(inode,nr,1)))
+				set_entry(sb,inode,bh,i,zone);
+		brelse(bh);
+	}
+	return 0;
 }
 
 int bmap(struct m_inode * inode,int block)
@@ -144,7 +317,18 @@ int bmap(struct m_inode * inode,int block)
 
 int create_block(struct m_inode * inode, int block)
 {
-	return _bmap(inode,block,1);
+	return create_blocks(inode,block,1);
+}
+
+/* like create_block(), but also allocates the count-1 blocks after it */
+int create_blocks(struct m_inode * inode, int block, int count)
+{
+	int nr;
+
+	journal_begin();
+	nr = _bmap(inode,block,count);
+	journal_end();
+	return nr;
 }
 		
 void iput(struct m_inode * inode)
@@ -159,13 +343,14 @@ void iput(struct m_inode * inode)
 		if (--inode->i_count)
 			return;
 		free_page(inode->i_size);
-		inode->i_count=0;
 		inode->i_dirt=0;
 		inode->i_pipe=0;
+		put_free(inode,0);
 		return;
 	}
 	if (!inode->i_dev) {
-		inode->i_count--;
+		if (!--inode->i_count)
+			put_free(inode,0);
 		return;
 	}
 	if (S_ISBLK(inode->i_mode)) {
@@ -178,49 +363,56 @@ repeat:
 		return;
 	}
 	if (!inode->i_nlinks) {
+		journal_begin();
 		truncate(inode);
 		free_inode(inode);
+		journal_end();
 		return;
 	}
+	if (inode->i_dirty_pages) {
+		write_inode_pages(inode);	/* we can sleep - so do again */
+		wait_on_inode(inode);
+		goto repeat;
+	}
 	if (inode->i_dirt) {
 		write_inode(inode);	/* we can sleep - so do again */
 		wait_on_inode(inode);
 		goto repeat;
 	}
+	discard_prealloc(inode);
 	inode->i_count--;
+	put_free(inode,1);
 	return;
 }
 
+/*
+ * Takes the least recently used free inode that is neither dirty nor
+ * locked, writing one out if there is no such inode.
+ */
 struct m_inode * get_empty_inode(void)
 {
 	struct m_inode * inode;
-	static struct m_inode * last_inode = inode_table;
-	int i;
 
 	do {
-		inode = NULL;
-		for (i = NR_INODE; i ; i--) {
-			if (++last_inode >= inode_table + NR_INODE)
-				last_inode = inode_table;
-			if (!last_inode->i_count) {
-				inode = last_inode;
-				if (!inode->i_dirt && !inode->i_lock)
-					break;
-			}
-		}
-		if (!inode) {
-			for (i=0 ; i<NR_INODE ; i++)
-				printk("%04x: %6d\t",inode_table[i].i_dev,
-					inode_table[i].i_num);
-			panic("No free inodes in mem");
+		if (nr_inodes < NR_INODE || !free_inodes)
+			grow_inodes();
+		if (!(inode = free_inodes)) {
+			printk("No free inodes in mem\n\r");
+			return NULL;
 		}
+		do {
+			if (!inode->i_dirt && !inode->i_lock)
+				break;
+			inode = inode->i_free_next;
+		} while (inode != free_inodes);
 		wait_on_inode(inode);
 		while (inode->i_dirt) {
 			write_inode(inode);
 			wait_on_inode(inode);
 		}
 	} while (inode->i_count);
-	memset(inode,0,sizeof(*inode));
+	remove_free(inode);
+	clear_inode(inode);
 	inode->i_count = 1;
 	return inode;
 }
@@ -233,6 +425,7 @@ struct m_inode * get_pipe_inode(void)
 		return NULL;
 	if (!(inode->i_size=get_free_page())) {
 		inode->i_count = 0;
+		put_free(inode,0);
 		return NULL;
 	}
 	inode->i_count = 2;	/* sum of readers/writers */
@@ -243,23 +436,17 @@ struct m_inode * get_pipe_inode(void)
 
 struct m_inode * iget(int dev,int nr)
 {
-	struct m_inode * inode, * empty;
+	struct m_inode * inode, * empty = NULL;
 
 	if (!dev)
 		panic("iget with dev==0");
-	empty = get_empty_inode();
-	inode = inode_table;
-	while (inode < NR_INODE+inode_table) {
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode++;
-			continue;
-		}
+repeat:
+	if ((inode = find_inode(dev,nr))) {
 		wait_on_inode(inode);
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode = inode_table;
-			continue;
-		}
-		inode->i_count++;
+		if (inode->i_dev != dev || inode->i_num != nr)
+			goto repeat;
+		if (!inode->i_count++)
+			remove_free(inode);
 		if (inode->i_mount) {
 			int i;
 
@@ -275,18 +462,22 @@ struct m_inode * iget(int dev,int nr)
 			iput(inode);
 			dev = super_block[i].s_dev;
 			nr = ROOT_INO;
-			inode = inode_table;
-			continue;
+			goto repeat;
 		}
 		if (empty)
 			iput(empty);
 		return inode;
 	}
-	if (!empty)
-		return (NULL);
+/* getting an empty inode may sleep, so look again afterwards */
+	if (!empty) {
+		if (!(empty = get_empty_inode()))
+			return NULL;
+		goto repeat;
+	}
 	inode=empty;
 	inode->i_dev = dev;
 	inode->i_num = nr;
+	insert_inode_hash(inode);
 	read_inode(inode);
 	return inode;
 }
@@ -295,18 +486,42 @@ static void read_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
+	int block, i;
 
 	lock_inode(inode);
 	if (!(sb=get_super(inode->i_dev)))
 		panic("trying to read inode without dev");
 	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
+		(inode->i_num-1)/INODES_PER_BLOCK(sb);
 	if (!(bh=bread(inode->i_dev,block)))
 		panic("unable to read i-node block");
-	*(struct d_inode *)inode =
-		((struct d_inode *)bh->b_data)
-			[(inode->i_num-1)%INODES_PER_BLOCK];
+	i = (inode->i_num-1)%INODES_PER_BLOCK(sb);
+	if (sb->s_version == MINIX_V2) {
+		struct d2_inode * d = i + (struct d2_inode *) bh->b_data;
+
+		inode->i_mode = d->i_mode;
+		inode->i_nlinks = d->i_nlinks;
+		inode->i_uid = d->i_uid;
+		inode->i_gid = d->i_gid;
+		inode->i_size = d->i_size;
+		inode->i_atime = d->i_atime;
+		inode->i_mtime = d->i_mtime;
+		inode->i_ctime = d->i_ctime;
+		for (i = 0 ; i < 10 ; i++)
+			inode->i_zone[i] = d->i_zone[i];
+	} else {
+		struct d_inode * d = i + (struct d_inode *) bh->b_data;
+
+		inode->i_mode = d->i_mode;
+		inode->i_uid = d->i_uid;
+		inode->i_size = d->i_size;
+		inode->i_atime = inode->i_mtime = inode->i_ctime = d->i_time;
+		inode->i_gid = d->i_gid;
+		inode->i_nlinks = d->i_nlinks;
+		for (i = 0 ; i < 9 ; i++)
+			inode->i_zone[i] = d->i_zone[i];
+		inode->i_zone[9] = 0;
+	}
 	brelse(bh);
 	unlock_inode(inode);
 }
@@ -315,7 +530,7 @@ static void write_inode(struct m_inode * inode)
 {
 	struct super_block * sb;
 	struct buffer_head * bh;
-	int block;
+	int block, i;
 
 	lock_inode(inode);
 	if (!inode->i_dirt || !inode->i_dev) {
@@ -325,13 +540,36 @@ static void write_inode(struct m_inode * inode)
 	if (!(sb=get_super(inode->i_dev)))
 		panic("trying to write inode without device");
 	block = 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
-		(inode->i_num-1)/INODES_PER_BLOCK;
+		(inode->i_num-1)/INODES_PER_BLOCK(sb);
 	if (!(bh=bread(inode->i_dev,block)))
 		panic("unable to read i-node block");
-	((struct d_inode *)bh->b_data)
-		[(inode->i_num-1)%INODES_PER_BLOCK] =
-			*(struct d_inode *)inode;
-	bh->b_dirt=1;
+	i = (inode->i_num-1)%INODES_PER_BLOCK(sb);
+	if (sb->s_version == MINIX_V2) {
+		struct d2_inode * d = i + (struct d2_inode *) bh->b_data;
+
+		d->i_mode = inode->i_mode;
+		d->i_nlinks = inode->i_nlinks;
+		d->i_uid = inode->i_uid;
+		d->i_gid = inode->i_gid;
+		d->i_size = inode->i_size;
+		d->i_atime = inode->i_atime;
+		d->i_mtime = inode->i_mtime;
+		d->i_ctime = inode->i_ctime;
+		for (i = 0 ; i < 10 ; i++)
+			d->i_zone[i] = inode->i_zone[i];
+	} else {
+		struct d_inode * d = i + (struct d_inode *) bh->b_data;
+
+		d->i_mode = inode->i_mode;
+		d->i_uid = inode->i_uid;
+		d->i_size = inode->i_size;
+		d->i_time = inode->i_mtime;
+		d->i_gid = inode->i_gid;
+		d->i_nlinks = inode->i_nlinks;
+		for (i = 0 ; i < 9 ; i++)
+			d->i_zone[i] = inode->i_zone[i];
+	}
+	journal_dirty(bh);
 	inode->i_dirt=0;
 	brelse(bh);
 	unlock_inode(inode);
@@ -0,0 +1,649 @@
+/*
+ *  linux/fs/journal.c
+ */
+
+/*
+ * A write-ahead journal for the meta-data of a file system: the bitmaps,
+ * inodes, indirect blocks and directories. File data isn't journaled.
+ * A file system with a regular file "/.journal" of at least JOURNAL_MIN
+ * blocks and no holes (made with dd from /dev/zero, say) gets it used
+ * as the log when it is mounted.
+ *
+ * journal_dirty() is called instead of mark_buffer_dirty() for meta-data.
+ * The buffer joins the running transaction, and is held and kept from
+ * being written in place until that is committed: copied into the log,
+ * a descriptor block with the block numbers before the copies, and a
+ * commit block after them once they are on the disk. Only then do the
+ * buffers go to their places. Transactions are committed by bdflush
+ * every interval, by sync, and when they get big, so that many updates
+ * share one sequential write to the log.
+ *
+ * Calls that change several blocks, and may sleep in between, are
+ * bracketed by journal_begin() and journal_end(). A commit waits until
+ * there are none in progress, so a transaction never has half of one.
+ *
+ * Log space is reused once the blocks of the transactions in it have
+ * been written in place - checkpoint() sees to that when the log runs
+ * out. The journal header tells where the oldest transaction that is
+ * still needed starts, and mounting replays the complete transactions
+ * from there on: recovery takes as long as the log, not the disk.
+ *
+ * A freed directory or indirect block that has a copy in the log is
+ * revoked, so that the replay doesn't put the copy over what the block
+ * was reused for. As only blocks in the log are revoked, and the log
+ * doesn't grow while a transaction runs, there are never more revoked
+ * blocks than the log has blocks.
+ */
+
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+#include <sys/stat.h>
+
+#define JOURNAL_NAME	".journal"
+#define JOURNAL_MAGIC	0x4c4e524a	/* "JRNL" */
+#define JOURNAL_MIN	64
+#define JOURNAL_MAX	512		/* blocks used, see j_bufs, j_blocks */
+#define JOURNAL_BATCH	64		/* buffers that make a big transaction */
+
+#define JT_HEADER	1
+#define JT_DESC		2
+#define JT_COMMIT	3
+
+/* starts the journal header and every log block but the copies */
+struct journal_head {
+	unsigned long h_magic;
+	unsigned long h_type;
+	unsigned long h_seq;
+};
+
+/* journal block 0 */
+struct journal_super {
+	struct journal_head js_h;	/* h_seq is the first transaction */
+	unsigned long js_size;		/* journal blocks */
+	unsigned long js_start;		/* where the first transaction is */
+};
+
+#define DESC_TAGS ((BLOCK_SIZE-sizeof (struct journal_head))/4 - 2)
+
+struct journal_desc {
+	struct journal_head d_h;
+	unsigned long d_blocks;		/* copies that follow */
+	unsigned long d_revokes;
+	unsigned long d_tag[DESC_TAGS];	/* their blocks, then revoked ones */
+};
+
+/* revoked blocks found by recovery */
+struct revoke {
+	unsigned long r_block;
+	unsigned long r_seq;
+};
+
+#define MAX_LOG_REVOKES (PAGE_SIZE/sizeof (struct revoke))
+
+/* j_blocks has the disk block of each journal block, then the home
+ * block of the copy at each log position (0 if it isn't a copy) */
+#define log_block(j,pos) ((j)->j_blocks[1 + (pos) % (j)->j_size])
+#define log_home(j,pos) ((j)->j_blocks[JOURNAL_MAX + (pos) % (j)->j_size])
+
+static struct journal journal_table[NR_SUPER];
+
+static int journal_updates = 0;
+static struct task_struct * updates_wait = NULL;
+
+static struct journal * find_journal(int dev)
+{
+	struct super_block * sb;
+
+	for (sb = super_block ; sb < super_block + NR_SUPER ; sb++)
+		if (sb->s_dev == dev && sb->s_journal)
+			return sb->s_journal;
+	return NULL;
+}
+
+/*
+ * Is the inode the journal of a mounted file system? Then it must not
+ * be written or truncated, as the log is written to its blocks.
+ */
+int journal_busy(struct m_inode * inode)
+{
+	struct super_block * sb;
+
+	for (sb = super_block ; sb < super_block + NR_SUPER ; sb++)
+		if (sb->s_journal && sb->s_journal->j_inode == inode)
+			return 1;
+	return 0;
+}
+
+/* log blocks in use */
+static int log_used(struct journal * j)
+{
+	if (j->j_first == j->j_seq)
+		return 0;
+	if (j->j_head == j->j_start)
+		return j->j_size;
+	return (j->j_head - j->j_start + j->j_size) % j->j_size;
+}
+
+static void write_header(struct journal * j)
+{
+	struct buffer_head * bh;
+	struct journal_super * js;
+
+	bh = getblk(j->j_dev,j->j_blocks[0]);
+	memset(bh->b_data,0,BLOCK_SIZE);
+	js = (struct journal_super *) bh->b_data;
+	js->js_h.h_magic = JOURNAL_MAGIC;
+	js->js_h.h_type = JT_HEADER;
+	js->js_h.h_seq = j->j_first;
+	js->js_size = j->j_size + 1;
+	js->js_start = j->j_start;
+	bh->b_uptodate = 1;
+	mark_buffer_dirty(bh);
+	ll_rw_block(WRITE,bh);
+	brelse(bh);		/* waits for it */
+}
+
+/*
+ * Writes the blocks of the committed transactions in place, and drops
+ * from the log those that are no longer needed: all but the ones that
+ * have the last committed copy of a buffer in the running transaction,
+ * as that can't be written until it commits.
+ */
+static void checkpoint(struct journal * j)
+{
+	struct buffer_head * bh;
+	unsigned long first;
+
+	fsync_dev(j->j_dev);
+	first = j->j_seq;
+	for (bh = j->j_running ; bh ; bh = bh->b_jnext)
+		if (bh->b_jseq >= j->j_first && bh->b_jseq < first)
+			first = bh->b_jseq;
+	if (first == j->j_first)
+		return;
+	for ( ; j->j_first < first ; j->j_first++)
+		j->j_log_revokes -= j->j_trev[j->j_first % NR_JTRANS];
+	if (first == j->j_seq)
+		j->j_start = j->j_head;
+	else
+		j->j_start = j->j_tpos[first % NR_JTRANS];
+	write_header(j);
+}
+
+/*
+ * The way out when a transaction doesn't fit in the log: its buffers
+ * are written in place like any others. The log is emptied afterwards,
+ * as the revoked blocks aren't in it to protect them from the replay.
+ */
+static void release_running(struct journal * j)
+{
+	struct buffer_head * bh, * next;
+
+	bh = j->j_running;
+	j->j_running = NULL;
+	j->j_nr_running = j->j_nr_revoked = 0;
+	j->j_tstart = 0;
+	for ( ; bh ; bh = next) {
+		next = bh->b_jnext;
+		bh->b_jnext = NULL;
+		bh->b_jstate = 0;
+		mark_buffer_dirty(bh);
+		brelse(bh);
+	}
+}
+
+static int log_full(struct journal * j, int need, int r)
+{
+	return need > j->j_size - log_used(j) ||
+		j->j_seq - j->j_first >= NR_JTRANS ||
+		j->j_log_revokes + r > MAX_LOG_REVOKES;
+}
+
+static void commit(struct journal * j)
+{
+	struct buffer_head ** log = j->j_bufs;
+	struct buffer_head ** done = j->j_bufs + JOURNAL_MAX;
+	struct buffer_head * bh;
+	struct journal_desc * d = NULL;
+	unsigned long gen;
+	int n, r, need, i, k;
+
+	while (j->j_committing)
+		sleep_on(&j->j_wait);
+	if (!j->j_dev)
+		return;
+	j->j_committing = 1;
+repeat:
+	while (journal_updates)
+		sleep_on(&updates_wait);
+	sync_inodes();
+	if (journal_updates)
+		goto repeat;
+	gen = j->j_gen;
+	n = j->j_nr_running;
+	r = j->j_nr_revoked;
+	if (!n && !r)
+		goto out;
+	need = (n+r+DESC_TAGS-1)/DESC_TAGS + n + 1;
+	if (need > j->j_size) {
+		printk("journal: transaction too big for the log\n\r");
+		release_running(j);
+		checkpoint(j);
+		goto out;
+	}
+	if (log_full(j,need,r)) {
+		checkpoint(j);
+		if (gen == j->j_gen && log_full(j,need,r)) {
+			printk("journal: log full\n\r");
+			release_running(j);
+			checkpoint(j);
+			goto out;
+		}
+		goto repeat;
+	}
+	for (i = 0 ; i < need ; i++)
+		log[i] = getblk(j->j_dev,log_block(j,j->j_head+i));
+	if (journal_updates || gen != j->j_gen) {
+		for (i = 0 ; i < need ; i++)
+			brelse(log[i]);
+		goto repeat;
+	}
+/* nothing sleeps from here until the transaction is taken off */
+	bh = j->j_running;
+	for (i = k = 0 ; k < n+r ; k++) {
+		if (!(k % DESC_TAGS)) {
+			log_home(j,j->j_head+i) = 0;
+			d = (struct journal_desc *) log[i++]->b_data;
+			memset(d,0,BLOCK_SIZE);
+			d->d_h.h_magic = JOURNAL_MAGIC;
+			d->d_h.h_type = JT_DESC;
+			d->d_h.h_seq = j->j_seq;
+		}
+		if (k < n) {
+			d->d_tag[d->d_blocks++] = bh->b_blocknr;
+			log_home(j,j->j_head+i) = bh->b_blocknr;
+			memcpy(log[i++]->b_data,bh->b_data,BLOCK_SIZE);
+			bh->b_jstate = JB_COMMITTING;
+			bh->b_jseq = j->j_seq;
+			done[k] = bh;
+			bh = bh->b_jnext;
+		} else
+			d->d_tag[d->d_blocks + d->d_revokes++] = j->j_revoked[k-n];
+	}
+	log_home(j,j->j_head+i) = 0;
+	d = (struct journal_desc *) log[i]->b_data;
+	memset(d,0,BLOCK_SIZE);
+	d->d_h.h_magic = JOURNAL_MAGIC;
+	d->d_h.h_type = JT_COMMIT;
+	d->d_h.h_seq = j->j_seq;
+	for (k = 0 ; k < n ; k++)
+		done[k]->b_jnext = NULL;
+	j->j_running = NULL;
+	j->j_nr_running = j->j_nr_revoked = 0;
+	j->j_tstart = 0;
+	j->j_tpos[j->j_seq % NR_JTRANS] = j->j_head;
+	j->j_trev[j->j_seq % NR_JTRANS] = r;
+	j->j_log_revokes += r;
+	j->j_head = (j->j_head + need) % j->j_size;
+	j->j_seq++;
+/* the copies first, then the commit block */
+	for (i = 0 ; i < need ; i++) {
+		log[i]->b_uptodate = 1;
+		if (i < need-1) {
+			mark_buffer_dirty(log[i]);
+			ll_rw_block(WRITE,log[i]);
+		}
+	}
+	for (i = 0 ; i < need-1 ; i++)
+		brelse(log[i]);
+	mark_buffer_dirty(log[need-1]);
+	ll_rw_block(WRITE,log[need-1]);
+	brelse(log[need-1]);
+/*
+ * Now the buffers can go to their places. They are written right away,
+ * so that their copies in the log are soon no longer needed - unless
+ * they are in the running transaction again.
+ */
+	for (k = 0 ; k < n ; k++) {
+		bh = done[k];
+		bh->b_jstate &= ~JB_COMMITTING;
+		if (!bh->b_jstate) {
+			mark_buffer_dirty(bh);
+			ll_rw_block(WRITE,bh);
+		}
+	}
+	for (k = 0 ; k < n ; k++)
+		brelse(done[k]);
+out:
+	j->j_committing = 0;
+	wake_up(&j->j_wait);
+}
+
+/*
+ * Commits the journals of dev (all if 0) whose running transaction is at
+ * least age ticks old. Must not be called between journal_begin() and
+ * journal_end().
+ */
+void journal_commit_all(int dev, int age)
+{
+	struct super_block * sb;
+	struct journal * j;
+
+	for (sb = super_block ; sb < super_block + NR_SUPER ; sb++) {
+		if (!(j = sb->s_journal) || (dev && sb->s_dev != dev))
+			continue;
+		if (!age || (j->j_tstart && jiffies - j->j_tstart >= age))
+			commit(j);
+	}
+}
+
+void journal_begin(void)
+{
+	struct super_block * sb;
+	struct journal * j;
+
+	if (!journal_updates)
+		for (sb = super_block ; sb < super_block + NR_SUPER ; sb++)
+			if ((j = sb->s_journal) && (j->j_nr_running >= JOURNAL_BATCH ||
+			    j->j_nr_revoked >= MAX_REVOKE/2))
+				commit(j);
+	journal_updates++;
+}
+
+void journal_end(void)
+{
+	if (!--journal_updates)
+		wake_up(&updates_wait);
+}
+
+/*
+ * Puts a changed meta-data buffer into the running transaction. Doesn't
+ * sleep.
+ */
+void journal_dirty(struct buffer_head * bh)
+{
+	struct journal * j;
+	int i;
+
+	if (!(j = find_journal(bh->b_dev))) {
+		mark_buffer_dirty(bh);
+		return;
+	}
+	j->j_gen++;
+	if (bh->b_jstate & JB_RUNNING)
+		return;
+/* if the block on the disk is up to date, no log copy of it is needed */
+	if (!bh->b_dirt && !bh->b_lock && !bh->b_jstate)
+		bh->b_jseq = 0;
+	bh->b_dirt = 0;
+	bh->b_jstate |= JB_RUNNING;
+	bh->b_count++;
+	bh->b_jnext = j->j_running;
+	j->j_running = bh;
+	j->j_nr_running++;
+	if (!j->j_tstart)
+		j->j_tstart = jiffies ? jiffies : 1;
+	for (i = 0 ; i < j->j_nr_revoked ; i++)
+		if (j->j_revoked[i] == bh->b_blocknr) {
+			j->j_revoked[i] = j->j_revoked[--j->j_nr_revoked];
+			break;
+		}
+}
+
+/*
+ * The block of bh is being freed: it is taken out of the running
+ * transaction. The caller holds bh.
+ */
+void journal_forget(struct buffer_head * bh)
+{
+	struct journal * j;
+	struct buffer_head ** p;
+
+	if (!(j = find_journal(bh->b_dev)))
+		return;
+	while (bh->b_jstate & JB_COMMITTING)
+		sleep_on(&j->j_wait);
+	if (!(bh->b_jstate & JB_RUNNING))
+		return;
+	for (p = &j->j_running ; *p ; p = &(*p)->b_jnext)
+		if (*p == bh) {
+			*p = bh->b_jnext;
+			break;
+		}
+	bh->b_jnext = NULL;
+	bh->b_jstate = 0;
+	bh->b_count--;
+	j->j_nr_running--;
+	j->j_gen++;
+}
+
+/* is there a copy of the block in the log? */
+static int in_log(struct journal * j, unsigned long block)
+{
+	int pos, n;
+
+	for (pos = j->j_start, n = log_used(j) ; n-- ; pos++)
+		if (log_home(j,pos) == block)
+			return 1;
+	return 0;
+}
+
+void journal_revoke(int dev, int block)
+{
+	struct journal * j;
+	int i;
+
+	if (!(j = find_journal(dev)) || !in_log(j,block))
+		return;
+	for (i = 0 ; i < j->j_nr_revoked ; i++)
+		if (j->j_revoked[i] == block)
+			return;
+	if (j->j_nr_revoked >= MAX_REVOKE)
+		panic("journal: too many revoked blocks");
+	j->j_revoked[j->j_nr_revoked++] = block;
+	j->j_gen++;
+	if (!j->j_tstart)
+		j->j_tstart = jiffies ? jiffies : 1;
+}
+
+static int revoked(struct revoke * rev, int nrev, unsigned long block,
+	unsigned long seq, unsigned long end)
+{
+	while (nrev--)
+		if (rev[nrev].r_block == block && rev[nrev].r_seq > seq &&
+		    rev[nrev].r_seq < end)
+			return 1;
+	return 0;
+}
+
+/*
+ * Goes through the log from its start. The first pass finds where the
+ * complete transactions end, and collects the revoked blocks. The
+ * second puts the copies of transactions before 'end' in place. Returns
+ * the first transaction that isn't there, and where it would start in
+ * *endpos.
+ */
+static unsigned long scan_log(struct journal * j, int replay,
+	unsigned long end, struct revoke * rev, int * nrev, int * endpos)
+{
+	struct buffer_head * bh, * from, * to;
+	struct journal_desc * d;
+	unsigned long seq = j->j_first;
+	int pos = j->j_start, i;
+
+	*endpos = pos;
+	while (pos - j->j_start < j->j_size && (!replay || seq < end)) {
+		if (!(bh = bread(j->j_dev,log_block(j,pos))))
+			break;
+		d = (struct journal_desc *) bh->b_data;
+		if (d->d_h.h_magic != JOURNAL_MAGIC || d->d_h.h_seq != seq) {
+			brelse(bh);
+			break;
+		}
+		if (d->d_h.h_type == JT_COMMIT) {
+			brelse(bh);
+			*endpos = ++pos % j->j_size;
+			seq++;
+			continue;
+		}
+		if (d->d_h.h_type != JT_DESC ||
+		    d->d_blocks + d->d_revokes > DESC_TAGS) {
+			brelse(bh);
+			break;
+		}
+		for (i = 0 ; replay && i < d->d_blocks ; i++) {
+			if (revoked(rev,*nrev,d->d_tag[i],seq,end))
+				continue;
+			if (!(from = bread(j->j_dev,log_block(j,pos+1+i))))
+				continue;
+			to = getblk(j->j_dev,d->d_tag[i]);
+			memcpy(to->b_data,from->b_data,BLOCK_SIZE);
+			to->b_uptodate = 1;
+			mark_buffer_dirty(to);
+			brelse(to);
+			brelse(from);
+		}
+		for (i = 0 ; !replay && i < d->d_revokes ; i++)
+			if (*nrev < MAX_LOG_REVOKES) {
+				rev[*nrev].r_block = d->d_tag[d->d_blocks+i];
+				rev[(*nrev)++].r_seq = seq;
+			}
+		pos += 1 + d->d_blocks;
+		brelse(bh);
+	}
+	return seq;
+}
+
+static void recover(struct journal * j, struct super_block * sb)
+{
+	struct m_inode * inode;
+	struct revoke * rev;
+	unsigned long end;
+	int nrev = 0, pos;
+
+	if (!(rev = (struct revoke *) get_free_page()))
+		panic("journal: no memory for recovery");
+	end = scan_log(j,0,0,rev,&nrev,&pos);
+	if (end != j->j_first) {
+		printk("journal: replaying %d transactions on %04x\n\r",
+			end - j->j_first,j->j_dev);
+		scan_log(j,1,end,rev,&nrev,&pos);
+		fsync_dev(j->j_dev);
+/* what was read before the replay may be out of date */
+		for (inode = first_inode ; inode ; inode = inode->i_next)
+			if (inode->i_dev == j->j_dev && !inode->i_count)
+				clear_inode(inode);
+		dcache_purge(j->j_dev,0);
+		count_free_bits(sb);
+	}
+	free_page((unsigned long) rev);
+	j->j_start = j->j_head = pos;
+	j->j_first = j->j_seq = end + 1;
+	write_header(j);
+}
+
+static void free_journal(struct journal * j)
+{
+	if (j->j_blocks)
+		free_page((unsigned long) j->j_blocks);
+	if (j->j_bufs)
+		free_page((unsigned long) j->j_bufs);
+	j->j_blocks = NULL;
+	j->j_bufs = NULL;
+	j->j_dev = 0;
+	wake_up(&j->j_wait);
+}
+
+/*
+ * Called when a file system is mounted: looks for the journal, and
+ * replays it if needed.
+ */
+void journal_init(struct super_block * sb)
+{
+	struct m_inode * inode;
+	struct journal * j;
+	struct buffer_head * bh;
+	struct journal_super * js;
+	int ino, size, i;
+
+	if (!(inode = iget(sb->s_dev,ROOT_INO)))
+		return;
+	ino = kernel_lookup(inode,JOURNAL_NAME);
+	iput(inode);
+	if (!ino || !(inode = iget(sb->s_dev,ino)))
+		return;
+	size = inode->i_size >> BLOCK_SIZE_BITS;
+	if (size > JOURNAL_MAX)
+		size = JOURNAL_MAX;
+	if (size > NR_BUFFERS/4)	/* commit() holds that many */
+		size = NR_BUFFERS/4;
+	for (j = journal_table ; j < journal_table + NR_SUPER ; j++)
+		if (!j->j_dev)
+			break;
+	if (!S_ISREG(inode->i_mode) || size < JOURNAL_MIN ||
+	    j >= journal_table + NR_SUPER) {
+		iput(inode);
+		return;
+	}
+	j->j_dev = sb->s_dev;
+	j->j_blocks = (unsigned long *) get_free_page();
+	j->j_bufs = (struct buffer_head **) get_free_page();
+	if (!j->j_blocks || !j->j_bufs)
+		goto fail;
+	for (i = 0 ; i < size ; i++)
+		if (!(j->j_blocks[i] = bmap(inode,i))) {
+			printk("journal: %s has holes\n\r",JOURNAL_NAME);
+			goto fail;
+		}
+	j->j_inode = inode;
+	j->j_size = size - 1;
+	j->j_running = NULL;
+	j->j_nr_running = j->j_nr_revoked = j->j_log_revokes = 0;
+	j->j_tstart = 0;
+	j->j_committing = 0;
+	if (!(bh = bread(j->j_dev,j->j_blocks[0])))
+		goto fail;
+	js = (struct journal_super *) bh->b_data;
+	if (js->js_h.h_magic == JOURNAL_MAGIC && js->js_h.h_type == JT_HEADER &&
+	    js->js_size == size && js->js_start < j->j_size) {
+		j->j_first = j->j_seq = js->js_h.h_seq;
+		j->j_start = j->j_head = js->js_start;
+		brelse(bh);
+		recover(j,sb);
+	} else {
+		brelse(bh);
+		j->j_first = j->j_seq = 1;
+		j->j_start = j->j_head = 0;
+		write_header(j);
+	}
+	sb->s_journal = j;
+	return;
+fail:
+	free_journal(j);
+	iput(inode);
+}
+
+/*
+ * Called when a file system is unmounted: everything is committed and
+ * written in place, so that the log is empty.
+ */
+void journal_release(struct super_block * sb)
+{
+	struct journal * j;
+
+	if (!(j = sb->s_journal))
+		return;
+	commit(j);
+	while (j->j_committing)
+		sleep_on(&j->j_wait);
+	j->j_committing = 1;
+	checkpoint(j);
+	sb->s_journal = NULL;
+	iput(j->j_inode);
+	j->j_inode = NULL;
+	j->j_committing = 0;
+	free_journal(j);
+}
@@ -205,10 +205,11 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 			dir->i_ctime = CURRENT_TIME;
 		}
 		if (!de->inode) {
+			dcache_invalidate(dir,name,namelen);
 			dir->i_mtime = CURRENT_TIME;
 			for (i=0; i < NAME_LEN ; i++)
 				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
-			bh->b_dirt = 1;
+			journal_dirty(bh);
 			*res_dir = de;
 			return bh;
 		}
@@ -219,6 +220,49 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 	return NULL;
 }
 
+/*
+ *	lookup()
+ *
+ * gives the inode number for a name in a directory, 0 if there is no
+ * such name. The dentry cache is asked first: only if it doesn't know
+ * are the directory blocks read. Like find_entry() it may exchange
+ * 'dir' for '..'.
+ */
+static int lookup(struct m_inode ** dir, const char * name, int namelen)
+{
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long seq;
+	int inr;
+
+	if ((inr = dcache_lookup(*dir,name,namelen)))
+		return (inr < 0) ? 0 : inr;
+	seq = dcache_seq;
+	inr = 0;
+	if ((bh = find_entry(dir,name,namelen,&de))) {
+		inr = de->inode;
+		brelse(bh);
+	}
+	dcache_add(*dir,name,namelen,inr,seq);
+	return inr;
+}
+
+/*
+ * lookup() for a name in kernel space, used to find the journal.
+ */
+int kernel_lookup(struct m_inode * dir, const char * name)
+{
+	unsigned long old_fs = get_fs();
+	int len, inr;
+
+	for (len = 0 ; name[len] ; len++)
+		/* nothing */;
+	set_fs(get_ds());
+	inr = lookup(&dir,name,len);
+	set_fs(old_fs);
+	return inr;
+}
+
 /*
  *	get_dir()
  *
@@ -230,9 +274,7 @@ static struct m_inode * get_dir(const char * pathname)
 	char c;
 	const char * thisname;
 	struct m_inode * inode;
-	struct buffer_head * bh;
 	int namelen,inr,idev;
-	struct dir_entry * de;
 
 	if (!current->root || !current->root->i_count)
 		panic("No root inode");
@@ -256,13 +298,11 @@ static struct m_inode * get_dir(const char * pathname)
 			/* nothing */ ;
 		if (!c)
 			return inode;
-		if (!(bh = find_entry(&inode,thisname,namelen,&de))) {
+		if (!(inr = lookup(&inode,thisname,namelen))) {
 			iput(inode);
 			return NULL;
 		}
-		inr = de->inode;
 		idev = inode->i_dev;
-		brelse(bh);
 		iput(inode);
 		if (!(inode = iget(idev,inr)))
 			return NULL;
@@ -305,21 +345,16 @@ struct m_inode * namei(const char * pathname)
 	const char * basename;
 	int inr,dev,namelen;
 	struct m_inode * dir;
-	struct buffer_head * bh;
-	struct dir_entry * de;
 
 	if (!(dir = dir_namei(pathname,&namelen,&basename)))
 		return NULL;
 	if (!namelen)			/* special case: '/usr/' etc */
 		return dir;
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) {
+	if (!(inr = lookup(&dir,basename,namelen))) {
 		iput(dir);
 		return NULL;
 	}
-	inr = de->inode;
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	dir=iget(dev,inr);
 	if (dir) {
@@ -334,7 +369,7 @@ struct m_inode * namei(const char * pathname)
  *
  * namei for open - this is in fact almost the whole open-routine.
  */
-int open_namei(const char * pathname, int flag, int mode,
+static int do_open_namei(const char * pathname, int flag, int mode,
 	struct m_inode ** res_inode)
 {
 	const char * basename;
@@ -357,8 +392,7 @@ int open_namei(const char * pathname, int flag, int mode,
 		iput(dir);
 		return -EISDIR;
 	}
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) {
+	if (!(inr = lookup(&dir,basename,namelen))) {
 		if (!(flag & O_CREAT)) {
 			iput(dir);
 			return -ENOENT;
@@ -383,15 +417,13 @@ int open_namei(const char * pathname, int flag, int mode,
 			return -ENOSPC;
 		}
 		de->inode = inode->i_num;
-		bh->b_dirt = 1;
+		journal_dirty(bh);
 		brelse(bh);
 		iput(dir);
 		*res_inode = inode;
 		return 0;
 	}
-	inr = de->inode;
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	if (flag & O_EXCL)
 		return -EEXIST;
@@ -402,6 +434,10 @@ int open_namei(const char * pathname, int flag, int mode,
 		iput(inode);
 		return -EPERM;
 	}
+	if (((flag & O_ACCMODE) || (flag & O_TRUNC)) && journal_busy(inode)) {
+		iput(inode);
+		return -ETXTBSY;
+	}
 	inode->i_atime = CURRENT_TIME;
 	if (flag & O_TRUNC)
 		truncate(inode);
@@ -409,7 +445,22 @@ int open_namei(const char * pathname, int flag, int mode,
 	return 0;
 }
 
-int sys_mknod(const char * filename, int mode, int dev)
+/*
+ * Each call that changes directories is one update of the journal, see
+ * fs/journal.c: a transaction holds all of it or nothing.
+ */
+int open_namei(const char * pathname, int flag, int mode,
+	struct m_inode ** res_inode)
+{
+	int retval;
+
+	journal_begin();
+	retval = do_open_namei(pathname,flag,mode,res_inode);
+	journal_end();
+	return retval;
+}
+
+static int do_mknod(const char * filename, int mode, int dev)
 {
 	const char * basename;
 	int namelen;
@@ -441,7 +492,7 @@ int sys_mknod(const char * filename, int mode, int dev)
 		return -ENOSPC;
 	}
 	inode->i_mode = mode;
-	if (S_ISBLK(mode) || S_ISCHR(mode))
+	if (S_ISBLK(mode) || S_ISCHR(mode) || S_ISPROC(mode))
 		inode->i_zone[0] = dev;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
 	inode->i_dirt = 1;
@@ -453,14 +504,24 @@ int sys_mknod(const char * filename, int mode, int dev)
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	iput(dir);
 	iput(inode);
 	brelse(bh);
 	return 0;
 }
 
-int sys_mkdir(const char * pathname, int mode)
+int sys_mknod(const char * filename, int mode, int dev)
+{
+	int retval;
+
+	journal_begin();
+	retval = do_mknod(filename,mode,dev);
+	journal_end();
+	return retval;
+}
+
+static int do_mkdir(const char * pathname, int mode)
 {
 	const char * basename;
 	int namelen;
@@ -494,7 +555,7 @@ int sys_mkdir(const char * pathname, int mode)
 	inode->i_size = 32;
 	inode->i_dirt = 1;
 	inode->i_mtime = inode->i_atime = CURRENT_TIME;
-	if (!(inode->i_zone[0]=new_block(inode->i_dev))) {
+	if (!(inode->i_zone[0]=new_block(inode->i_dev,0))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
@@ -515,7 +576,7 @@ int sys_mkdir(const char * pathname, int mode)
 	de->inode = dir->i_num;
 	strcpy(de->name,"..");
 	inode->i_nlinks = 2;
-	dir_block->b_dirt = 1;
+	journal_dirty(dir_block);
 	brelse(dir_block);
 	inode->i_mode = I_DIRECTORY | (mode & 0777 & ~current->umask);
 	inode->i_dirt = 1;
@@ -528,7 +589,7 @@ int sys_mkdir(const char * pathname, int mode)
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	dir->i_nlinks++;
 	dir->i_dirt = 1;
 	iput(dir);
@@ -537,6 +598,16 @@ int sys_mkdir(const char * pathname, int mode)
 	return 0;
 }
 
+int sys_mkdir(const char * pathname, int mode)
+{
+	int retval;
+
+	journal_begin();
+	retval = do_mkdir(pathname,mode);
+	journal_end();
+	return retval;
+}
+
 /*
  * routine to check that the specified directory is empty (for rmdir)
  */
@@ -584,7 +655,7 @@ static int empty_dir(struct m_inode * inode)
 	return 1;
 }
 
-int sys_rmdir(const char * name)
+static int do_rmdir(const char * name)
 {
 	const char * basename;
 	int namelen;
@@ -648,8 +719,10 @@ int sys_rmdir(const char * name)
 	if (inode->i_nlinks != 2)
 		printk("empty directory has nlink!=2 (%d)",inode->i_nlinks);
 	de->inode = 0;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	brelse(bh);
+	dcache_invalidate(dir,basename,namelen);
+	dcache_purge(inode->i_dev,inode->i_num);
 	inode->i_nlinks=0;
 	inode->i_dirt=1;
 	dir->i_nlinks--;
@@ -660,7 +733,17 @@ int sys_rmdir(const char * name)
 	return 0;
 }
 
-int sys_unlink(const char * name)
+int sys_rmdir(const char * name)
+{
+	int retval;
+
+	journal_begin();
+	retval = do_rmdir(name);
+	journal_end();
+	return retval;
+}
+
+static int do_unlink(const char * name)
 {
 	const char * basename;
 	int namelen;
@@ -708,8 +791,9 @@ int sys_unlink(const char * name)
 		inode->i_nlinks=1;
 	}
 	de->inode = 0;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	brelse(bh);
+	dcache_invalidate(dir,basename,namelen);
 	inode->i_nlinks--;
 	inode->i_dirt = 1;
 	inode->i_ctime = CURRENT_TIME;
@@ -718,7 +802,17 @@ int sys_unlink(const char * name)
 	return 0;
 }
 
-int sys_link(const char * oldname, const char * newname)
+int sys_unlink(const char * name)
+{
+	int retval;
+
+	journal_begin();
+	retval = do_unlink(name);
+	journal_end();
+	return retval;
+}
+
+static int do_link(const char * oldname, const char * newname)
 {
 	struct dir_entry * de;
 	struct m_inode * oldinode, * dir;
@@ -767,7 +861,7 @@ int sys_link(const char * oldname, const char * newname)
 		return -ENOSPC;
 	}
 	de->inode = oldinode->i_num;
-	bh->b_dirt = 1;
+	journal_dirty(bh);
 	brelse(bh);
 	iput(dir);
 	oldinode->i_nlinks++;
@@ -776,3 +870,13 @@ int sys_link(const char * oldname, const char * newname)
 	iput(oldinode);
 	return 0;
 }
+
+int sys_link(const char * oldname, const char * newname)
+{
+	int retval;
+
+	journal_begin();
+	retval = do_link(oldname,newname);
+	journal_end();
+	return retval;
+}
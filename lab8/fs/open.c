@@ -18,7 +18,19 @@
 
 int sys_ustat(int dev, struct ustat * ubuf)
 {
-	return -ENOSYS;
+	struct super_block * sb;
+	int i;
+
+	if (!(sb = get_super(dev)))
+		return -EINVAL;
+	verify_area(ubuf,sizeof (* ubuf));
+	put_fs_long(sb->s_free_zones,(unsigned long *) &ubuf->f_tfree);
+	put_fs_word(sb->s_free_inodes,(short *) &ubuf->f_tinode);
+	for (i=0 ; i<6 ; i++) {
+		put_fs_byte(0,ubuf->f_fname+i);
+		put_fs_byte(0,ubuf->f_fpack+i);
+	}
+	return 0;
 }
 
 int sys_utime(char * filename, struct utimbuf * times)
@@ -182,6 +194,9 @@ int sys_open(const char * filename,int flag,int mode)
 	f->f_count = 1;
 	f->f_inode = inode;
 	f->f_pos = 0;
+	f->f_ra_prev = 0;
+	f->f_ra_next = 0;
+	f->f_ra_blocks = 0;
 	return (fd);
 }
 
@@ -31,8 +31,8 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
 		size = PIPE_TAIL(*inode);
 		PIPE_TAIL(*inode) += chars;
 		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			put_fs_byte(((char *)inode->i_size)[size++],buf++);
+		copy_to_user(buf,size + (char *) inode->i_size,chars);
+		buf += chars;
 	}
 	wake_up(&inode->i_wait);
 	return read;
@@ -61,8 +61,8 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 		size = PIPE_HEAD(*inode);
 		PIPE_HEAD(*inode) += chars;
 		PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			((char *)inode->i_size)[size++]=get_fs_byte(buf++);
+		copy_from_user(size + (char *) inode->i_size,buf,chars);
+		buf += chars;
 	}
 	wake_up(&inode->i_wait);
 	return written;
@@ -0,0 +1,114 @@
+/*
+ *  linux/fs/proc.c
+ */
+
+/*
+ * A very small /proc: special files (S_IFPROC, made with mknod like
+ * device files) whose i_zone[0] says which information they give.
+ * Every read formats it afresh into a page and copies out from the
+ * file position, so reading from position 0 gets a new snapshot.
+ */
+
+#include <stdarg.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+#define PROC_PSINFO	0
+#define PROC_HDINFO	1
+#define PROC_BUFINFO	2
+
+extern int vsprintf(char * buf, const char * fmt, va_list args);
+
+static int sprintf(char * buf, const char * fmt, ...)
+{
+	va_list args;
+	int i;
+
+	va_start(args, fmt);
+	i=vsprintf(buf, fmt, args);
+	va_end(args);
+	return i;
+}
+
+static int get_psinfo(char * buf)
+{
+	struct task_struct ** p;
+	int len;
+
+	len = sprintf(buf,"pid\tstate\tfather\tcounter\tstart_time\n");
+	for (p = &FIRST_TASK ; p <= &LAST_TASK ; p++)
+		if (*p && len < PAGE_SIZE-64)
+			len += sprintf(buf+len,"%d\t%d\t%d\t%d\t%d\n",
+				(*p)->pid,(*p)->state,(*p)->father,
+				(*p)->counter,(*p)->start_time);
+	return len;
+}
+
+static int get_hdinfo(char * buf)
+{
+	struct super_block * sb;
+	int len;
+
+	if (!(sb = get_super(ROOT_DEV)))
+		return 0;
+	len = sprintf(buf,"Total blocks: %d\nFree blocks: %d\n",
+		sb->s_nzones,sb->s_free_zones);
+	len += sprintf(buf+len,"Total inodes: %d\nFree inodes: %d\n",
+		sb->s_ninodes,sb->s_free_inodes);
+	return len;
+}
+
+static int get_bufinfo(char * buf)
+{
+	struct buffer_head * bh;
+	int i, n, used = 0, longest = 0;
+
+	for (i = 0 ; i < nr_hash ; i++) {
+		for (n = 0, bh = hash_table[i] ; bh ; bh = bh->b_next)
+			n++;
+		if (n)
+			used++;
+		if (n > longest)
+			longest = n;
+	}
+	return sprintf(buf,"Buffers: %d\nHash buckets: %d\n"
+		"Used buckets: %d\nLongest chain: %d\n"
+		"Hits: %u\nMisses: %u\nProbes: %u\n",
+		NR_BUFFERS,nr_hash,used,longest,
+		buffer_hits,buffer_misses,buffer_probes);
+}
+
+int proc_read(int dev, off_t * pos, char * buf, int count)
+{
+	unsigned long page;
+	int len;
+
+	if (!(page = get_free_page()))
+		return -ENOMEM;
+	switch (dev) {
+		case PROC_PSINFO:
+			len = get_psinfo((char *) page);
+			break;
+		case PROC_HDINFO:
+			len = get_hdinfo((char *) page);
+			break;
+		case PROC_BUFINFO:
+			len = get_bufinfo((char *) page);
+			break;
+		default:
+			free_page(page);
+			return -EINVAL;
+	}
+	if (*pos >= len)
+		count = 0;
+	else if (count > len - *pos)
+		count = len - *pos;
+	copy_to_user(buf,*pos + (char *) page,count);
+	*pos += count;
+	free_page(page);
+	return count;
+}
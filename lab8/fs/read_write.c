@@ -7,6 +7,8 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 
 #include <linux/kernel.h>
 #include <linux/sched.h>
@@ -21,6 +23,7 @@ extern int file_read(struct m_inode * inode, struct file * filp,
 		char * buf, int count);
 extern int file_write(struct m_inode * inode, struct file * filp,
 		char * buf, int count);
+extern int proc_read(int dev, off_t * pos, char * buf, int count);
 
 int sys_lseek(unsigned int fd,off_t offset, int origin)
 {
@@ -52,13 +55,14 @@ int sys_lseek(unsigned int fd,off_t offset, int origin)
 	return file->f_pos;
 }
 
-int sys_read(unsigned int fd,char * buf,int count)
+/*
+ * do_read() and do_write() work at file->f_pos, and are shared by the
+ * plain, positioned and vectored calls below.
+ */
+static int do_read(struct file * file, char * buf, int count)
 {
-	struct file * file;
 	struct m_inode * inode;
 
-	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
-		return -EINVAL;
 	if (!count)
 		return 0;
 	verify_area(buf,count);
@@ -69,6 +73,8 @@ int sys_read(unsigned int fd,char * buf,int count)
 		return rw_char(READ,inode->i_zone[0],buf,count,&file->f_pos);
 	if (S_ISBLK(inode->i_mode))
 		return block_read(inode->i_zone[0],&file->f_pos,buf,count);
+	if (S_ISPROC(inode->i_mode))
+		return proc_read(inode->i_zone[0],&file->f_pos,buf,count);
 	if (S_ISDIR(inode->i_mode) || S_ISREG(inode->i_mode)) {
 		if (count+file->f_pos > inode->i_size)
 			count = inode->i_size - file->f_pos;
@@ -80,13 +86,10 @@ int sys_read(unsigned int fd,char * buf,int count)
 	return -EINVAL;
 }
 
-int sys_write(unsigned int fd,char * buf,int count)
+static int do_write(struct file * file, char * buf, int count)
 {
-	struct file * file;
 	struct m_inode * inode;
-	
-	if (fd>=NR_OPEN || count <0 || !(file=current->filp[fd]))
-		return -EINVAL;
+
 	if (!count)
 		return 0;
 	inode=file->f_inode;
@@ -101,3 +104,227 @@ int sys_write(unsigned int fd,char * buf,int count)
 	printk("(Write)inode->i_mode=%06o\n\r",inode->i_mode);
 	return -EINVAL;
 }
+
+int sys_read(unsigned int fd,char * buf,int count)
+{
+	struct file * file;
+
+	if (fd>=NR_OPEN || count<0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	return do_read(file,buf,count);
+}
+
+int sys_write(unsigned int fd,char * buf,int count)
+{
+	struct file * file;
+	
+	if (fd>=NR_OPEN || count <0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	return do_write(file,buf,count);
+}
+
+/*
+ * pread() and pwrite() work on a private copy of the file structure
+ * with f_pos set to the offset, so the shared file position is left
+ * alone even if we sleep and somebody else uses it meanwhile. The
+ * offset is honoured for O_APPEND files too. Like mmap(), they get a
+ * pointer to their 4 arguments: fd, buf, count and offset.
+ */
+static int get_pio(unsigned long * args, struct file * tmp,
+	char ** buf, int * count)
+{
+	struct file * file;
+	unsigned long fd;
+	off_t pos;
+
+	fd = get_fs_long(args);
+	*buf = (char *) get_fs_long(args+1);
+	*count = get_fs_long(args+2);
+	pos = get_fs_long(args+3);
+	if (fd>=NR_OPEN || *count<0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (!file->f_inode || file->f_inode->i_pipe)
+		return -ESPIPE;
+	if (pos<0)
+		return -EINVAL;
+	*tmp = *file;
+	tmp->f_pos = pos;
+	tmp->f_flags &= ~O_APPEND;
+	return 0;
+}
+
+int sys_pread(unsigned long * args)
+{
+	struct file tmp;
+	char * buf;
+	int count, error;
+
+	if ((error = get_pio(args,&tmp,&buf,&count)))
+		return error;
+	return do_read(&tmp,buf,count);
+}
+
+int sys_pwrite(unsigned long * args)
+{
+	struct file tmp;
+	char * buf;
+	int count, error;
+
+	if ((error = get_pio(args,&tmp,&buf,&count)))
+		return error;
+	return do_write(&tmp,buf,count);
+}
+
+/*
+ * readv() and writev() go through the buffers in order, and stop at
+ * the first one that isn't done completely: the count returned is what
+ * was transferred before that, unless nothing was.
+ */
+static int do_rwv(int rw, unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	struct file * file;
+	char * base;
+	int len, n, done = 0;
+
+	if (fd>=NR_OPEN || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (iovcnt<0 || iovcnt>UIO_MAXIOV)
+		return -EINVAL;
+	for ( ; iovcnt-- ; iov++) {
+		base = (char *) get_fs_long((unsigned long *) &iov->iov_base);
+		len = get_fs_long((unsigned long *) &iov->iov_len);
+		if (len<0)
+			return done?done:-EINVAL;
+		if (rw == READ)
+			n = do_read(file,base,len);
+		else
+			n = do_write(file,base,len);
+		if (n<0)
+			return done?done:n;
+		done += n;
+		if (n<len)
+			break;
+	}
+	return done;
+}
+
+int sys_readv(unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	return do_rwv(READ,fd,iov,iovcnt);
+}
+
+int sys_writev(unsigned int fd, struct iovec * iov, int iovcnt)
+{
+	return do_rwv(WRITE,fd,iov,iovcnt);
+}
+
+/*
+ * sendfile() and copy_file_range() copy from a regular file without
+ * going through user space: each page cache piece of the input goes
+ * straight to the output's write routine, with fs pointing at kernel
+ * space so that it takes the page for its user buffer. That is one
+ * copy of the data instead of two.
+ */
+static int send_actor(void * desc, char * from, int count)
+{
+	unsigned long old_fs = get_fs();
+	int n;
+
+	set_fs(get_ds());
+	n = do_write((struct file *) desc,from,count);
+	set_fs(old_fs);
+	return n;
+}
+
+/*
+ * An offset pointer means a private copy of the file at that position,
+ * as for pread(), and the new position is stored back through it.
+ */
+static int do_sendfile(struct file * in, off_t * off_in,
+	struct file * out, off_t * off_out, int count)
+{
+	struct file tin, tout;
+	struct m_inode * inode = in->f_inode;
+	int n;
+
+	if (!inode || !S_ISREG(inode->i_mode) || !out->f_inode)
+		return -EINVAL;
+	if (count<0)
+		return -EINVAL;
+	if (off_in) {
+		verify_area(off_in,4);
+		tin = *in;
+		if ((tin.f_pos = get_fs_long((unsigned long *) off_in)) < 0)
+			return -EINVAL;
+		in = &tin;
+	}
+	if (off_out) {
+		if (out->f_inode->i_pipe)
+			return -ESPIPE;
+		verify_area(off_out,4);
+		tout = *out;
+		if ((tout.f_pos = get_fs_long((unsigned long *) off_out)) < 0)
+			return -EINVAL;
+		tout.f_flags &= ~O_APPEND;
+		out = &tout;
+	}
+	if (count+in->f_pos > inode->i_size)
+		count = inode->i_size - in->f_pos;
+	if (count<=0)
+		return 0;
+	if (out->f_inode == inode && in->f_pos < out->f_pos+count &&
+	    out->f_pos < in->f_pos+count)
+		return -EINVAL;
+	n = generic_file_read(inode,in,count,send_actor,out);
+	if (off_in)
+		put_fs_long(tin.f_pos,(unsigned long *) off_in);
+	if (off_out)
+		put_fs_long(tout.f_pos,(unsigned long *) off_out);
+	return n;
+}
+
+/*
+ * sendfile() gets a pointer to its 4 arguments: out_fd, in_fd, offset
+ * and count. The output can be anything write() takes.
+ */
+int sys_sendfile(unsigned long * args)
+{
+	struct file * in, * out;
+	unsigned long out_fd, in_fd;
+
+	out_fd = get_fs_long(args);
+	in_fd = get_fs_long(args+1);
+	if (out_fd>=NR_OPEN || !(out=current->filp[out_fd]))
+		return -EBADF;
+	if (in_fd>=NR_OPEN || !(in=current->filp[in_fd]))
+		return -EBADF;
+	return do_sendfile(in,(off_t *) get_fs_long(args+2),
+		out,NULL,get_fs_long(args+3));
+}
+
+/*
+ * copy_file_range() gets a pointer to its 6 arguments: fd_in, off_in,
+ * fd_out, off_out, len and flags. Both files have to be regular, and
+ * no flags are defined yet.
+ */
+int sys_copy_file_range(unsigned long * args)
+{
+	struct file * in, * out;
+	unsigned long fd_in, fd_out;
+
+	fd_in = get_fs_long(args);
+	fd_out = get_fs_long(args+2);
+	if (fd_in>=NR_OPEN || !(in=current->filp[fd_in]))
+		return -EBADF;
+	if (fd_out>=NR_OPEN || !(out=current->filp[fd_out]))
+		return -EBADF;
+	if (get_fs_long(args+5))
+		return -EINVAL;
+	if (!out->f_inode || !S_ISREG(out->f_inode->i_mode) ||
+	    out->f_inode->i_pipe)
+		return -EINVAL;
+	if (out->f_flags & O_APPEND)
+		return -EBADF;
+	return do_sendfile(in,(off_t *) get_fs_long(args+1),
+		out,(off_t *) get_fs_long(args+3),get_fs_long(args+4));
+}
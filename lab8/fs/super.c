@@ -18,12 +18,6 @@
 int sync_dev(int dev);
 void wait_for_keypress(void);
 
-/* set_bit uses setb, as gas doesn't recognize setc */
-#define set_bit(bitnr,addr) ({ \
-register int __res ; \
-__asm__("bt %2,%3;setb %%al":"=a" (__res):"a" (0),"r" (bitnr),"m" (*(addr))); \
-__res; })
-
 struct super_block super_block[NR_SUPER];
 /* this is initialized in init/main.c */
 int ROOT_DEV = 0;
@@ -100,6 +94,7 @@ void put_super(int dev)
 static struct super_block * read_super(int dev)
 {
 	struct super_block * s;
+	struct d_super_block * ds;
 	struct buffer_head * bh;
 	int i,block;
 
@@ -120,16 +115,32 @@ static struct super_block * read_super(int dev)
 	s->s_time = 0;
 	s->s_rd_only = 0;
 	s->s_dirt = 0;
+	s->s_journal = NULL;
 	lock_super(s);
 	if (!(bh = bread(dev,1))) {
 		s->s_dev=0;
 		free_super(s);
 		return NULL;
 	}
-	*((struct d_super_block *) s) =
-		*((struct d_super_block *) bh->b_data);
+	ds = (struct d_super_block *) bh->b_data;
+	s->s_ninodes = ds->s_ninodes;
+	s->s_imap_blocks = ds->s_imap_blocks;
+	s->s_zmap_blocks = ds->s_zmap_blocks;
+	s->s_firstdatazone = ds->s_firstdatazone;
+	s->s_log_zone_size = ds->s_log_zone_size;
+	s->s_max_size = ds->s_max_size;
+	s->s_magic = ds->s_magic;
+	if (s->s_magic == SUPER_MAGIC) {
+		s->s_version = MINIX_V1;
+		s->s_nzones = ds->s_nzones;
+	} else if (s->s_magic == SUPER_MAGIC_V2) {
+		s->s_version = MINIX_V2;
+		s->s_nzones = ds->s_zones;
+	} else
+		s->s_version = 0;
 	brelse(bh);
-	if (s->s_magic != SUPER_MAGIC) {
+	if (!s->s_version || s->s_imap_blocks > I_MAP_SLOTS ||
+	    s->s_zmap_blocks > Z_MAP_SLOTS) {
 		s->s_dev = 0;
 		free_super(s);
 		return NULL;
@@ -160,7 +171,9 @@ static struct super_block * read_super(int dev)
 	}
 	s->s_imap[0]->b_data[0] |= 1;
 	s->s_zmap[0]->b_data[0] |= 1;
+	count_free_bits(s);
 	free_super(s);
+	journal_init(s);
 	return s;
 }
 
@@ -184,15 +197,18 @@ int sys_umount(char * dev_name)
 		return -ENOENT;
 	if (!sb->s_imount->i_mount)
 		printk("Mounted inode has i_mount=0\n");
-	for (inode=inode_table+0 ; inode<inode_table+NR_INODE ; inode++)
-		if (inode->i_dev==dev && inode->i_count)
+	for (inode=first_inode ; inode ; inode=inode->i_next)
+		if (inode->i_dev==dev && inode->i_count &&
+		    !(sb->s_journal && inode == sb->s_journal->j_inode))
 				return -EBUSY;
+	journal_release(sb);
 	sb->s_imount->i_mount=0;
 	iput(sb->s_imount);
 	sb->s_imount = NULL;
 	iput(sb->s_isup);
 	sb->s_isup = NULL;
 	put_super(dev);
+	dcache_purge(dev,0);
 	sync_dev(dev);
 	return 0;
 }
@@ -241,11 +257,11 @@ int sys_mount(char * dev_name, char * dir_name, int rw_flag)
 
 void mount_root(void)
 {
-	int i,free;
+	int i;
 	struct super_block * p;
 	struct m_inode * mi;
 
-	if (32 != sizeof (struct d_inode))
+	if (32 != sizeof (struct d_inode) || 64 != sizeof (struct d2_inode))
 		panic("bad i-node size");
 	for(i=0;i<NR_FILE;i++)
 		file_table[i].f_count=0;
@@ -266,16 +282,6 @@ void mount_root(void)
 	p->s_isup = p->s_imount = mi;
 	current->pwd = mi;
 	current->root = mi;
-	free=0;
-	i=p->s_nzones;
-	while (-- i >= 0)
-		if (!set_bit(i&8191,p->s_zmap[i>>13]->b_data))
-			free++;
-	printk("%d/%d free blocks\n\r",free,p->s_nzones);
-	free=0;
-	i=p->s_ninodes+1;
-	while (-- i >= 0)
-		if (!set_bit(i&8191,p->s_imap[i>>13]->b_data))
-			free++;
-	printk("%d/%d free inodes\n\r",free,p->s_ninodes);
+	printk("%d/%d free blocks\n\r",p->s_free_zones,p->s_nzones);
+	printk("%d/%d free inodes\n\r",p->s_free_inodes,p->s_ninodes);
 }
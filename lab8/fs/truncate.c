@@ -5,59 +5,72 @@
  */
 
 #include <linux/sched.h>
+#include <linux/kernel.h>
 
 #include <sys/stat.h>
 
-static void free_ind(int dev,int block)
+/*
+ * Frees a block that the journal may have a copy of: an indirect block,
+ * or a block of a directory. Replaying the journal must not put the copy
+ * back once the block has been reused.
+ */
+static void free_meta(int dev, int block)
 {
-	struct buffer_head * bh;
-	unsigned short * p;
-	int i;
-
-	if (!block)
-		return;
-	if ((bh=bread(dev,block))) {
-		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
-			if (*p)
-				free_block(dev,*p);
-		brelse(bh);
-	}
+	journal_revoke(dev,block);
 	free_block(dev,block);
 }
 
-static void free_dind(int dev,int block)
+/*
+ * Frees an indirect block of the given depth (1 for single, up to 3 for
+ * triple indirect) and everything below it.
+ */
+static void free_ind(struct super_block * sb,int block,int depth,int dir)
 {
 	struct buffer_head * bh;
-	unsigned short * p;
-	int i;
+	int i, nr;
 
 	if (!block)
 		return;
-	if ((bh=bread(dev,block))) {
-		p = (unsigned short *) bh->b_data;
-		for (i=0;i<512;i++,p++)
-			if (*p)
-				free_ind(dev,*p);
+	if ((bh=bread(sb->s_dev,block))) {
+		for (i=0;i < 1<<ZONE_BITS(sb);i++)
+			if ((nr = ind_zone(sb,bh->b_data,i))) {
+				if (depth > 1)
+					free_ind(sb,nr,depth-1,dir);
+				else if (dir)
+					free_meta(sb->s_dev,nr);
+				else
+					free_block(sb->s_dev,nr);
+			}
 		brelse(bh);
 	}
-	free_block(dev,block);
+	free_meta(sb->s_dev,block);
 }
 
 void truncate(struct m_inode * inode)
 {
-	int i;
+	struct super_block * sb;
+	int i, dir;
 
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
 		return;
+	discard_prealloc(inode);
+	invalidate_inode_pages(inode);
+	inode->i_ext_len = 0;
+	dir = S_ISDIR(inode->i_mode);
 	for (i=0;i<7;i++)
 		if (inode->i_zone[i]) {
-			free_block(inode->i_dev,inode->i_zone[i]);
+			if (dir)
+				free_meta(inode->i_dev,inode->i_zone[i]);
+			else
+				free_block(inode->i_dev,inode->i_zone[i]);
 			inode->i_zone[i]=0;
 		}
-	free_ind(inode->i_dev,inode->i_zone[7]);
-	free_dind(inode->i_dev,inode->i_zone[8]);
-	inode->i_zone[7] = inode->i_zone[8] = 0;
+	if (!(sb = get_super(inode->i_dev)))
+		panic("truncate: no super block");
+	for (i=7;i<10;i++) {
+		free_ind(sb,inode->i_zone[i],i-6,dir);
+		inode->i_zone[i]=0;
+	}
 	inode->i_size = 0;
 	inode->i_dirt = 1;
 	inode->i_mtime = inode->i_ctime = CURRENT_TIME;
@@ -24,7 +24,7 @@ static inline unsigned long get_fs_long(const unsigned long *addr)
 
 static inline void put_fs_byte(char val,char *addr)
 {
-__asm__ ("movb %0,%%fs:%1"::"r" (val),"m" (*addr));
+__asm__ ("movb %0,%%fs:%1"::"q" (val),"m" (*addr));
 }
 
 static inline void put_fs_word(short val,short * addr)
@@ -37,6 +37,75 @@ static inline void put_fs_long(unsigned long val,unsigned long * addr)
 __asm__ ("movl %0,%%fs:%1"::"r" (val),"m" (*addr));
 }
 
+/*
+ * Bulk copies between kernel space (%ds/%es) and user space (%fs): the
+ * destination is first brought to a long boundary a byte at a time,
+ * then longs are moved with 'rep movsl', then the last odd bytes. movs
+ * always stores through %es, so copy_to_user and clear_user load %fs
+ * into %es for the copy.
+ *
+ * There is no fault fixup: as for the byte routines, the caller has to
+ * verify_area() the user buffer first, so that write-protected pages
+ * are taken care of, and reads fault in like any user access.
+ */
+#define COPY_HEAD(to,n) (((n) >= 8) ? (-(unsigned long) (to) & 3) : 0)
+
+static inline void copy_to_user(char * to, const char * from, unsigned long n)
+{
+	unsigned long head = COPY_HEAD(to,n);
+	int d0,d1,d2,d3,d4;
+
+	__asm__ __volatile__ ("push %%es\n\t"
+		"push %%fs\n\t"
+		"pop %%es\n\t"
+		"cld\n\t"
+		"rep ; movsb\n\t"
+		"movl %%eax,%%ecx\n\t"
+		"rep ; movsl\n\t"
+		"movl %%edx,%%ecx\n\t"
+		"rep ; movsb\n\t"
+		"pop %%es"
+		:"=c" (d0),"=D" (d1),"=S" (d2),"=a" (d3),"=d" (d4)
+		:"0" (head),"1" (to),"2" (from),
+		 "3" ((n-head) >> 2),"4" ((n-head) & 3)
+		:"memory");
+}
+
+static inline void copy_from_user(char * to, const char * from,
+	unsigned long n)
+{
+	unsigned long head = COPY_HEAD(to,n);
+	int d0,d1,d2,d3,d4;
+
+	__asm__ __volatile__ ("cld\n\t"
+		"fs ; rep ; movsb\n\t"
+		"movl %%eax,%%ecx\n\t"
+		"fs ; rep ; movsl\n\t"
+		"movl %%edx,%%ecx\n\t"
+		"fs ; rep ; movsb"
+		:"=c" (d0),"=D" (d1),"=S" (d2),"=a" (d3),"=d" (d4)
+		:"0" (head),"1" (to),"2" (from),
+		 "3" ((n-head) >> 2),"4" ((n-head) & 3)
+		:"memory");
+}
+
+static inline void clear_user(char * to, unsigned long n)
+{
+	int d0,d1;
+
+	__asm__ __volatile__ ("push %%es\n\t"
+		"push %%fs\n\t"
+		"pop %%es\n\t"
+		"cld\n\t"
+		"rep ; stosl\n\t"
+		"movl %%edx,%%ecx\n\t"
+		"rep ; stosb\n\t"
+		"pop %%es"
+		:"=c" (d0),"=D" (d1)
+		:"a" (0),"0" (n >> 2),"1" (to),"d" (n & 3)
+		:"memory");
+}
+
 /*
  * Someone who knows GNU asm better than I should double check the followig.
  * It seems to work, but I don't know if I'm doing something subtly wrong.
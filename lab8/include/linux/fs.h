@@ -37,14 +37,18 @@ void buffer_init(long buffer_end);
 #define ROOT_INO 1
 
 #define I_MAP_SLOTS 8
-#define Z_MAP_SLOTS 8
+#define Z_MAP_SLOTS 64
 #define SUPER_MAGIC 0x137F
+#define SUPER_MAGIC_V2 0x2468
+
+#define MINIX_V1 1		/* 16-bit zones, double indirect at most */
+#define MINIX_V2 2		/* 32-bit zones, triple indirect */
 
 #define NR_OPEN 20
-#define NR_INODE 32
+#define NR_INODE 128	/* kept before unused inodes are reused */
+#define NR_IHASH 131
 #define NR_FILE 64
 #define NR_SUPER 8
-#define NR_HASH 307
 #define NR_BUFFERS nr_buffers
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
@@ -52,7 +56,11 @@ void buffer_init(long buffer_end);
 #define NULL ((void *) 0)
 #endif
 
-#define INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct d_inode)))
+#define INODES_PER_BLOCK(sb) ((BLOCK_SIZE)/((sb)->s_version == MINIX_V2 ? \
+	sizeof (struct d2_inode) : sizeof (struct d_inode)))
+#define ZONE_BITS(sb) ((sb)->s_version == MINIX_V2 ? 8 : 9)
+#define ind_zone(sb,data,i) ((sb)->s_version == MINIX_V2 ? \
+	((unsigned long *) (data))[i] : ((unsigned short *) (data))[i])
 #define DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct dir_entry)))
 
 #define PIPE_HEAD(inode) ((inode).i_zone[0])
@@ -63,6 +71,17 @@ void buffer_init(long buffer_end);
 #define INC_PIPE(head) \
 __asm__("incl %0\n\tandl $4095,%0"::"m" (head))
 
+/* block device ioctls: the I/O scheduler and depth of the device's queue */
+#define BLKGETSCHED	0x1201
+#define BLKSETSCHED	0x1202
+#define BLKGETDEPTH	0x1203
+#define BLKSETDEPTH	0x1204
+
+#define IOSCHED_NOOP		0
+#define IOSCHED_ELEVATOR	1
+#define IOSCHED_DEADLINE	2
+#define NR_IOSCHED		3
+
 typedef char buffer_block[BLOCK_SIZE];
 
 struct buffer_head {
@@ -73,13 +92,30 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
+	unsigned char b_list;		/* lru list, when b_count is 0 */
+	unsigned char b_on_dirty;	/* on a dirty list */
+	unsigned long b_flushtime;	/* when a dirty buffer is due */
 	struct task_struct * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
 	struct buffer_head * b_prev_free;
 	struct buffer_head * b_next_free;
+	struct buffer_head * b_prev_dirty;
+	struct buffer_head * b_next_dirty;
+	struct buffer_head * b_reqnext;	/* next buffer of the request */
+	unsigned char b_jstate;		/* in a transaction, see journal.c */
+	unsigned long b_jseq;		/* transaction last committed in */
+	struct buffer_head * b_jnext;	/* running transaction */
 };
 
+#define BUF_CLEAN	0		/* clean, used once */
+#define BUF_USED	1		/* clean, found in the cache again */
+#define BUF_DIRTY	2
+#define NR_LIST		3
+
+#define JB_RUNNING	1		/* in the running transaction */
+#define JB_COMMITTING	2		/* being written to the log */
+
 struct d_inode {
 	unsigned short i_mode;
 	unsigned short i_uid;
@@ -90,18 +126,35 @@ struct d_inode {
 	unsigned short i_zone[9];
 };
 
+struct d2_inode {
+	unsigned short i_mode;
+	unsigned short i_nlinks;
+	unsigned short i_uid;
+	unsigned short i_gid;
+	unsigned long i_size;
+	unsigned long i_atime;
+	unsigned long i_mtime;
+	unsigned long i_ctime;
+	unsigned long i_zone[10];
+};
+
+/*
+ * The in-memory inode holds either kind of disk inode: read_inode() and
+ * write_inode() convert. A v1 inode has no triple indirect zone, and
+ * only the one time, kept as i_mtime.
+ */
 struct m_inode {
 	unsigned short i_mode;
 	unsigned short i_uid;
 	unsigned long i_size;
 	unsigned long i_mtime;
-	unsigned char i_gid;
-	unsigned char i_nlinks;
-	unsigned short i_zone[9];
-/* these are in memory also */
-	struct task_struct * i_wait;
+	unsigned short i_gid;
+	unsigned short i_nlinks;
+	unsigned long i_zone[10];
 	unsigned long i_atime;
 	unsigned long i_ctime;
+/* these are in memory also */
+	struct task_struct * i_wait;
 	unsigned short i_dev;
 	unsigned short i_num;
 	unsigned short i_count;
@@ -111,6 +164,21 @@ struct m_inode {
 	unsigned char i_mount;
 	unsigned char i_seek;
 	unsigned char i_update;
+	unsigned short i_dirty_pages;	/* dirty pages in the page cache */
+	unsigned short i_ra_pages;	/* readahead window on page faults */
+	unsigned long i_ra_prev;
+	unsigned long i_ra_end;
+	unsigned long i_prealloc_block;		/* blocks reserved for appending */
+	unsigned short i_prealloc_count;
+	unsigned short i_ext_len;		/* cached extent, see _bmap() */
+	unsigned long i_ext_block;
+	unsigned long i_ext_zone;
+/* these are kept when the inode is cleared */
+	struct m_inode * i_next;		/* all inodes */
+	struct m_inode * i_hash_next;
+	struct m_inode * i_hash_prev;
+	struct m_inode * i_free_next;		/* unused inodes, oldest first */
+	struct m_inode * i_free_prev;
 };
 
 struct file {
@@ -119,11 +187,14 @@ struct file {
 	unsigned short f_count;
 	struct m_inode * f_inode;
 	off_t f_pos;
+	off_t f_ra_prev;		/* where the last read ended */
+	unsigned long f_ra_next;	/* readahead started up to this block */
+	unsigned short f_ra_blocks;	/* readahead window, 0 if random */
 };
 
 struct super_block {
 	unsigned short s_ninodes;
-	unsigned short s_nzones;
+	unsigned long s_nzones;		/* s_zones on a v2 file system */
 	unsigned short s_imap_blocks;
 	unsigned short s_zmap_blocks;
 	unsigned short s_firstdatazone;
@@ -131,8 +202,9 @@ struct super_block {
 	unsigned long s_max_size;
 	unsigned short s_magic;
 /* These are only in memory */
-	struct buffer_head * s_imap[8];
-	struct buffer_head * s_zmap[8];
+	unsigned char s_version;	/* MINIX_V1 or MINIX_V2 */
+	struct buffer_head * s_imap[I_MAP_SLOTS];
+	struct buffer_head * s_zmap[Z_MAP_SLOTS];
 	unsigned short s_dev;
 	struct m_inode * s_isup;
 	struct m_inode * s_imount;
@@ -141,6 +213,42 @@ struct super_block {
 	unsigned char s_lock;
 	unsigned char s_rd_only;
 	unsigned char s_dirt;
+	unsigned long s_zsearch;	/* zone map bit to search from */
+	unsigned short s_imap_free[I_MAP_SLOTS];	/* clear bits per block */
+	unsigned short s_zmap_free[Z_MAP_SLOTS];
+	unsigned long s_free_inodes;
+	unsigned long s_free_zones;
+	struct journal * s_journal;	/* NULL if not journaled */
+};
+
+/*
+ * A mounted file system's journal (fs/journal.c). Positions in the log
+ * count from 0 at the block after the journal header.
+ */
+#define NR_JTRANS	64		/* transactions in the log at most */
+#define MAX_REVOKE	512		/* revoked blocks per transaction */
+
+struct journal {
+	unsigned short j_dev;		/* 0 if the slot is free */
+	struct m_inode * j_inode;
+	unsigned long * j_blocks;	/* see log_block() and log_home() */
+	struct buffer_head ** j_bufs;	/* used by commit() */
+	int j_size;			/* log blocks */
+	int j_start;			/* where transaction j_first starts */
+	int j_head;			/* where transaction j_seq will go */
+	unsigned long j_first;		/* oldest transaction still needed */
+	unsigned long j_seq;		/* the running transaction */
+	unsigned long j_gen;		/* bumped when it changes */
+	unsigned long j_tstart;		/* when it started, 0 if empty */
+	struct buffer_head * j_running;
+	int j_nr_running;
+	int j_nr_revoked;
+	int j_log_revokes;		/* revoked blocks in the log */
+	unsigned char j_committing;
+	struct task_struct * j_wait;
+	unsigned short j_tpos[NR_JTRANS];	/* where transactions start */
+	unsigned short j_trev[NR_JTRANS];	/* and their revokes */
+	unsigned long j_revoked[MAX_REVOKE];
 };
 
 struct d_super_block {
@@ -152,6 +260,8 @@ struct d_super_block {
 	unsigned short s_log_zone_size;
 	unsigned long s_max_size;
 	unsigned short s_magic;
+	unsigned short s_state;
+	unsigned long s_zones;		/* v2 only */
 };
 
 struct dir_entry {
@@ -159,10 +269,14 @@ struct dir_entry {
 	char name[NAME_LEN];
 };
 
-extern struct m_inode inode_table[NR_INODE];
+extern struct m_inode * first_inode;
+extern int nr_inodes;
 extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
+extern struct buffer_head ** hash_table;
+extern int nr_hash;
+extern unsigned long buffer_hits, buffer_misses, buffer_probes;
 extern int nr_buffers;
 
 extern void check_disk_change(int dev);
@@ -175,25 +289,59 @@ extern void sync_inodes(void);
 extern void wait_on(struct m_inode * inode);
 extern int bmap(struct m_inode * inode,int block);
 extern int create_block(struct m_inode * inode,int block);
+extern int create_blocks(struct m_inode * inode, int block, int count);
+typedef int (*read_actor_t)(void * desc, char * from, int count);
+extern int generic_file_read(struct m_inode * inode, struct file * filp,
+	int count, read_actor_t actor, void * desc);
 extern struct m_inode * namei(const char * pathname);
+extern unsigned long dcache_seq;
+extern int dcache_lookup(struct m_inode * dir, const char * name, int len);
+extern void dcache_add(struct m_inode * dir, const char * name, int len,
+	int ino, unsigned long seq);
+extern void dcache_invalidate(struct m_inode * dir, const char * name,
+	int len);
+extern void dcache_purge(int dev, int dir);
 extern int open_namei(const char * pathname, int flag, int mode,
 	struct m_inode ** res_inode);
 extern void iput(struct m_inode * inode);
 extern struct m_inode * iget(int dev,int nr);
 extern struct m_inode * get_empty_inode(void);
+extern void insert_inode_hash(struct m_inode * inode);
+extern void clear_inode(struct m_inode * inode);
 extern struct m_inode * get_pipe_inode(void);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
 extern void brelse(struct buffer_head * buf);
+extern void wait_on_buffer(struct buffer_head * bh);
+extern void readahead_block(int dev, int block);
+extern void mark_buffer_dirty(struct buffer_head * bh);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
+extern int brw_page(int rw,unsigned long addr,int dev,int b[4]);
+extern void brw_page_start(int rw,struct buffer_head * tmp,unsigned long addr,
+	int dev,int b[4]);
+extern int brw_page_wait(struct buffer_head * tmp);
 extern struct buffer_head * breada(int dev,int block,...);
-extern int new_block(int dev);
+extern int new_block(int dev, int goal);
+extern int new_file_block(struct m_inode * inode, int goal, int clear);
+extern void discard_prealloc(struct m_inode * inode);
+extern void count_free_bits(struct super_block * sb);
 extern void free_block(int dev, int block);
 extern struct m_inode * new_inode(int dev);
 extern void free_inode(struct m_inode * inode);
 extern int sync_dev(int dev);
+extern int fsync_dev(int dev);
+extern int kernel_lookup(struct m_inode * dir, const char * name);
+extern void journal_init(struct super_block * sb);
+extern void journal_release(struct super_block * sb);
+extern void journal_dirty(struct buffer_head * bh);
+extern void journal_forget(struct buffer_head * bh);
+extern void journal_revoke(int dev, int block);
+extern void journal_begin(void);
+extern void journal_end(void);
+extern void journal_commit_all(int dev, int age);
+extern int journal_busy(struct m_inode * inode);
 extern struct super_block * get_super(int dev);
 extern int ROOT_DEV;
 
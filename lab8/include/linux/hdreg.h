@@ -40,6 +40,45 @@
 #define WIN_SEEK 		0x70
 #define WIN_DIAGNOSE		0x90
 #define WIN_SPECIFY		0x91
+#define WIN_READ_EXT		0x24	/* 48-bit addressing */
+#define WIN_WRITE_EXT		0x34
+#define WIN_MULTREAD_EXT	0x29
+#define WIN_MULTWRITE_EXT	0x39
+#define WIN_MULTREAD		0xC4	/* a block of sectors per interrupt */
+#define WIN_MULTWRITE		0xC5
+#define WIN_SETMULT		0xC6	/* sectors per block */
+#define WIN_READDMA		0xC8	/* bus-master DMA */
+#define WIN_WRITEDMA		0xCA
+#define WIN_READDMA_EXT		0x25
+#define WIN_WRITEDMA_EXT	0x35
+#define WIN_IDENTIFY		0xEC
+
+/* Bits of HD_CURRENT */
+#define LBA_SELECT		0x40	/* sector number is an LBA */
+
+/* Words of the IDENTIFY data */
+#define ID_MAX_MULTSECT		47	/* low byte: max sectors per block */
+#define ID_CAPABILITIES		49	/* 0x0200: LBA, 0x0100: DMA */
+#define ID_LBA_CAPACITY		60	/* 2 words: nr of LBA28 sectors */
+#define ID_COMMAND_SET_2	83	/* 0x0400: 48-bit addressing */
+#define ID_LBA48_CAPACITY	100	/* 4 words: nr of LBA48 sectors */
+
+/*
+ * PCI IDE bus-master registers, from the base in BAR4 of the controller
+ * (+8 for the second channel).
+ */
+#define BM_COMMAND	0	/* bit 0 start, bit 3 device to memory */
+#define BM_STATUS	2	/* see bm-bits, 1 clears */
+#define BM_PRD		4	/* physical address of the PRD table */
+
+#define BM_START	0x01
+#define BM_READ		0x08
+
+#define BM_ACTIVE	0x01
+#define BM_ERR		0x02
+#define BM_INTR		0x04
+
+#define PRD_EOT		0x80000000	/* last entry of the table */
 
 /* Bits for HD_ERROR */
 #define MARK_ERR	0x01	/* Bad address mark ? */
@@ -3,8 +3,115 @@
 
 #define PAGE_SIZE 4096
 
+struct task_struct;
+struct m_inode;
+
+/* these are not to be changed without changing head.s etc */
+#define LOW_MEM 0x100000
+#define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
+#define USED 100
+
+/*
+ * mem_map (and page_map) are sized at boot, from the memory the bios
+ * reports: there are paging_pages entries, one for every page between
+ * LOW_MEM and the end of memory.
+ */
+extern unsigned long paging_pages;
+extern unsigned char * mem_map;
+
 extern unsigned long get_free_page(void);
 extern unsigned long put_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern unsigned long map_page(unsigned long page,unsigned long address,
+	unsigned long prot);
+
+/*
+ * Every task has a page directory of its own (tss.cr3). The entries
+ * below TASK_BASE map the kernel, and are the same in all of them: they
+ * are copied from pg_dir. User space is TASK_SIZE bytes at TASK_BASE in
+ * every task, which is where the code and data segments point.
+ */
+#define TASK_BASE	0x40000000
+#define TASK_SIZE	0x40000000
+#define KERNEL_PGD_ENTRIES (TASK_BASE>>22)
+
+/* all physical memory is identity-mapped in the kernel part */
+#define MAX_MEMORY	TASK_BASE
+
+#define pgd_entry(p,address) \
+	((unsigned long *) (p)->tss.cr3 + ((unsigned long) (address)>>22))
+
+#define invalidate() \
+__asm__("movl %%cr3,%%eax\n\tmovl %%eax,%%cr3":::"ax")
+
+/*
+ * The page cache: every page of paging memory has a struct page, which
+ * says which file page (if any) it caches. A cached page holds one
+ * reference in mem_map, so it can be dropped when that is the only one.
+ */
+struct page {
+	unsigned short p_dev;		/* 0 if not in the page cache */
+	unsigned short p_ino;
+	unsigned long p_offset;
+	unsigned short p_flags;
+	struct m_inode * p_inode;	/* only valid while dirty */
+	unsigned long p_dirtied;	/* when it was made dirty */
+	struct page * p_next;		/* hash chain */
+	struct task_struct * p_wait;
+};
+
+#define PG_locked	1
+#define PG_uptodate	2
+#define PG_dirty	4
+#define PG_referenced	8
+
+extern struct page * page_map;
+
+#define PAGE_STRUCT(addr) (page_map + MAP_NR(addr))
+#define PAGE_ADDR(p) (LOW_MEM + (((p) - page_map) << 12))
+
+extern unsigned long read_cache_page(struct m_inode * inode,
+	unsigned long offset);
+extern unsigned long fault_readahead(struct m_inode * inode,
+	unsigned long offset);
+extern int page_cached(struct m_inode * inode, unsigned long offset);
+extern void read_cache_data(struct m_inode * inode, unsigned long offset,
+	char * buf, int count);
+extern void mark_page_dirty(unsigned long page, struct m_inode * inode);
+extern void write_cache_page(unsigned long page);
+extern void write_inode_pages(struct m_inode * inode);
+extern void invalidate_inode_pages(struct m_inode * inode);
+extern void invalidate_pages(int dev);
+extern void sync_pages(int dev);
+extern int write_dirty_pages(int nr, long age);
+extern void balance_dirty_pages(void);
+extern int shrink_page_cache(void);
+extern unsigned long page_cache_init(unsigned long start_mem);
+
+/*
+ * A file mapping set up by mmap(). Addresses are relative to the start
+ * of the data space, like brk and start_stack, and page aligned. The
+ * list hanging off the task is kept sorted by address.
+ */
+struct vm_area_struct {
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned short vm_prot;
+	unsigned short vm_flags;
+	struct m_inode * vm_inode;
+	unsigned long vm_offset;
+	struct vm_area_struct * vm_next;
+};
+
+/* the top 8MB of user space are left for the stack */
+#define MMAP_TOP	(TASK_SIZE - 0x800000)
+
+extern struct vm_area_struct * find_vma(unsigned long address);
+extern int do_mmap_page(struct vm_area_struct * vma, unsigned long address);
+extern int do_mmap_wp_page(struct vm_area_struct * vma,
+	unsigned long * table_entry);
+extern int copy_mmap(struct task_struct * p);
+extern void exit_mmap(void);
+extern unsigned long mmap_base(void);
 
 #endif
@@ -1,7 +1,7 @@
 #ifndef _SCHED_H
 #define _SCHED_H
 
-#define NR_TASKS 64
+#define NR_TASKS 126	/* as many as fit in the GDT */
 #define NR_THREADS_PER_TASK 10
 #define HZ 100
 
@@ -28,8 +28,10 @@
 #define NULL ((void *) 0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
-extern int free_page_tables(unsigned long from, unsigned long size);
+extern int copy_page_tables(unsigned long from, unsigned long to, long size,
+	struct task_struct * p);
+extern int free_page_tables(unsigned long from, unsigned long size,
+	struct task_struct * p);
 extern int get_task_nr(long pid,long tid);
 extern int find_empty_process(void);
 extern void sched_init(void);
@@ -108,6 +110,8 @@ struct task_struct {
 	struct m_inode * executable;
 	unsigned long close_on_exec;
 	struct file * filp[NR_OPEN];
+/* file mappings, see mm/mmap.c */
+	struct vm_area_struct * mmap;
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
 	struct desc_struct ldt[3];
 /* tss for this task */
@@ -130,6 +134,7 @@ struct task_struct {
 /* math */	0, \
 /* fs info */	-1,0022,NULL,NULL,NULL,0, \
 /* filp */	{NULL,}, \
+/* mmap */	NULL, \
 	{ \
 		{0,0}, \
 /* ldt */	{0x9f,0xc0fa00}, \
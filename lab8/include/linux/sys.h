@@ -76,6 +76,16 @@ extern int sys_thread_exit();
 extern int sys_thread_join();
 extern int sys_thread_status();
 extern int sys_thread_gettid();
+extern int sys_mmap();
+extern int sys_munmap();
+extern int sys_msync();
+extern int sys_bdflush();
+extern int sys_pread();
+extern int sys_pwrite();
+extern int sys_readv();
+extern int sys_writev();
+extern int sys_sendfile();
+extern int sys_copy_file_range();
 
 fn_ptr sys_call_table[] = { sys_setup, sys_exit, sys_fork, sys_read,
 sys_write, sys_open, sys_close, sys_waitpid, sys_creat, sys_link,
@@ -90,4 +100,6 @@ sys_lock, sys_ioctl, sys_fcntl, sys_mpx, sys_setpgid, sys_ulimit,
 sys_uname, sys_umask, sys_chroot, sys_ustat, sys_dup2, sys_getppid,
 sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
 sys_setreuid,sys_setregid, sys_make_thread, sys_thread_cancel,
-sys_thread_exit, sys_thread_join, sys_thread_status, sys_thread_gettid};
+sys_thread_exit, sys_thread_join, sys_thread_status, sys_thread_gettid,
+sys_mmap, sys_munmap, sys_msync, sys_bdflush, sys_pread, sys_pwrite,
+sys_readv, sys_writev, sys_sendfile, sys_copy_file_range };
@@ -0,0 +1,26 @@
+#ifndef _SYS_MMAN_H
+#define _SYS_MMAN_H
+
+#include <sys/types.h>
+
+#define PROT_NONE	0x0
+#define PROT_READ	0x1
+#define PROT_WRITE	0x2
+#define PROT_EXEC	0x4
+
+#define MAP_SHARED	0x01	/* changes go to the file */
+#define MAP_PRIVATE	0x02	/* changes are private */
+#define MAP_TYPE	0x0f
+#define MAP_FIXED	0x10	/* use the given address */
+
+#define MAP_FAILED	((void *) -1)
+
+#define MS_ASYNC	1	/* start the writes, don't wait */
+#define MS_INVALIDATE	2	/* drop the cached pages */
+#define MS_SYNC		4	/* wait for the writes */
+
+void * mmap(void * addr, size_t len, int prot, int flags, int fd, off_t off);
+int munmap(void * addr, size_t len);
+int msync(void * addr, size_t len, int flags);
+
+#endif
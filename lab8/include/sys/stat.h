@@ -21,6 +21,7 @@ struct stat {
 #define S_IFREG  0100000
 #define S_IFBLK  0060000
 #define S_IFDIR  0040000
+#define S_IFPROC 0030000
 #define S_IFCHR  0020000
 #define S_IFIFO  0010000
 #define S_ISUID  0004000
@@ -32,6 +33,7 @@ struct stat {
 #define S_ISCHR(m)	(((m) & S_IFMT) == S_IFCHR)
 #define S_ISBLK(m)	(((m) & S_IFMT) == S_IFBLK)
 #define S_ISFIFO(m)	(((m) & S_IFMT) == S_IFIFO)
+#define S_ISPROC(m)	(((m) & S_IFMT) == S_IFPROC)
 
 #define S_IRWXU 00700
 #define S_IRUSR 00400
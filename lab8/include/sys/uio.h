@@ -0,0 +1,16 @@
+#ifndef _SYS_UIO_H
+#define _SYS_UIO_H
+
+#include <sys/types.h>
+
+#define UIO_MAXIOV	16	/* most buffers one readv/writev takes */
+
+struct iovec {
+	void * iov_base;
+	size_t iov_len;
+};
+
+int readv(int fildes, const struct iovec * iov, int iovcnt);
+int writev(int fildes, const struct iovec * iov, int iovcnt);
+
+#endif
@@ -135,6 +135,16 @@
 #define __NR_thread_join 75
 #define __NR_thread_status 76
 #define __NR_thread_gettid 77
+#define __NR_mmap	78
+#define __NR_munmap	79
+#define __NR_msync	80
+#define __NR_bdflush	81
+#define __NR_pread	82
+#define __NR_pwrite	83
+#define __NR_readv	84
+#define __NR_writev	85
+#define __NR_sendfile	86
+#define __NR_copy_file_range 87
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -155,7 +165,8 @@ type name(atype a) \
 long __res; \
 __asm__ volatile ("int $0x80" \
 	: "=a" (__res) \
-	: "0" (__NR_##name),"b" ((long)(a))); \
+	: "0" (__NR_##name),"b" ((long)(a)) \
+	: "memory"); \
 if (__res >= 0) \
 	return (type) __res; \
 errno = -__res; \
@@ -168,7 +179,8 @@ type name(atype a,btype b) \
 long __res; \
 __asm__ volatile ("int $0x80" \
 	: "=a" (__res) \
-	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b))); \
+	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b)) \
+	: "memory"); \
 if (__res >= 0) \
 	return (type) __res; \
 errno = -__res; \
@@ -181,7 +193,8 @@ type name(atype a,btype b,ctype c) \
 long __res; \
 __asm__ volatile ("int $0x80" \
 	: "=a" (__res) \
-	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b)),"d" ((long)(c))); \
+	: "0" (__NR_##name),"b" ((long)(a)),"c" ((long)(b)),"d" ((long)(c)) \
+	: "memory"); \
 if (__res>=0) \
 	return (type) __res; \
 errno=-__res; \
@@ -255,5 +268,11 @@ int dup2(int oldfd, int newfd);
 int getppid(void);
 pid_t getpgrp(void);
 pid_t setsid(void);
+int bdflush(int func, long data);
+int pread(int fildes, void * buf, size_t count, off_t offset);
+int pwrite(int fildes, const void * buf, size_t count, off_t offset);
+int sendfile(int out_fd, int in_fd, off_t * offset, size_t count);
+int copy_file_range(int fd_in, off_t * off_in, int fd_out, off_t * off_out,
+	size_t len, unsigned int flags);
 
 #endif
@@ -24,6 +24,7 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 static inline _syscall0(int,sync)
+static inline _syscall2(int,bdflush,int,func,long,data)
 
 #include <linux/tty.h>
 #include <linux/sched.h>
@@ -36,11 +37,15 @@ static inline _syscall0(int,sync)
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <linux/fs.h>
 
 static char printbuf[1024];
 
+_syscall2(int,mkdir,const char *,name,mode_t,mode)
+_syscall3(int,mknod,const char *,filename,mode_t,mode,dev_t,dev)
+
 extern int vsprintf();
 extern void init(void);
 extern void blk_dev_init(void);
@@ -48,6 +53,7 @@ extern void chr_dev_init(void);
 extern void hd_init(void);
 extern void floppy_init(void);
 extern void mem_init(long start, long end);
+extern long mem_init_size(long end);
 extern long rd_init(long mem_start, int length);
 extern long kernel_mktime(struct tm * tm);
 extern long startup_time;
@@ -56,6 +62,8 @@ extern long startup_time;
  * This is set up by the setup-routine at boot-time
  */
 #define EXT_MEM_K (*(unsigned short *)0x90002)
+#define E820_NR (*(unsigned char *)0x901E0)
+#define E820_MAP ((struct e820_entry *)0x900A0)
 #define DRIVE_INFO (*(struct drive_info *)0x90080)
 #define ORIG_ROOT_DEV (*(unsigned short *)0x901FC)
 
@@ -98,9 +106,40 @@ static void time_init(void)
 static long memory_end = 0;
 static long buffer_memory_end = 0;
 static long main_memory_start = 0;
+static long low_memory_end = 0;
 
 struct drive_info { char dummy[32]; } drive_info;
 
+struct e820_entry {
+	unsigned long addr, addr_hi;
+	unsigned long size, size_hi;
+	unsigned long type;
+};
+
+#define E820_RAM 1
+
+/*
+ * Memory is the usable e820 area that contains the first megabyte
+ * of extended memory: there can be holes above that, but we want
+ * one contiguous range. Returns 0 if the bios didn't give us a map.
+ */
+static unsigned long e820_memory_end(void)
+{
+	struct e820_entry * e;
+	int i;
+
+	for (i=0 ; i<E820_NR ; i++) {
+		e = E820_MAP + i;
+		if (e->type != E820_RAM || e->addr_hi || e->addr > 0x100000)
+			continue;
+		if (e->size_hi || e->addr + e->size < e->addr)
+			return MAX_MEMORY;
+		if (e->addr + e->size > 0x100000)
+			return e->addr + e->size;
+	}
+	return 0;
+}
+
 void main(void)		/* This really IS void, no error here. */
 {			/* The startup routine assumes (well, ...) this */
 /*
@@ -109,16 +148,23 @@ void main(void)		/* This really IS void, no error here. */
  */
  	ROOT_DEV = ORIG_ROOT_DEV;
  	drive_info = DRIVE_INFO;
-	memory_end = (1<<20) + (EXT_MEM_K<<10);
+	if (!(memory_end = e820_memory_end()))
+		memory_end = (1<<20) + (EXT_MEM_K<<10);
 	memory_end &= 0xfffff000;
-	if (memory_end > 16*1024*1024)
-		memory_end = 16*1024*1024;
-	if (memory_end > 12*1024*1024) 
-		buffer_memory_end = 4*1024*1024;
-	else if (memory_end > 6*1024*1024)
-		buffer_memory_end = 2*1024*1024;
-	else
+	if (memory_end > MAX_MEMORY)
+		memory_end = MAX_MEMORY;
+/* file data lives in the page cache, buffers are only for meta-data */
+	buffer_memory_end = (memory_end >> 4) & 0xfffff000;
+	if (buffer_memory_end < 1*1024*1024)
 		buffer_memory_end = 1*1024*1024;
+/* the ramdisk and mem_init() must fit into the 16MB head.s has mapped */
+	low_memory_end = 16*1024*1024 - mem_init_size(memory_end);
+#ifdef RAMDISK
+	low_memory_end -= RAMDISK*1024;
+#endif
+	low_memory_end &= 0xfffff000;
+	if (buffer_memory_end > low_memory_end)
+		buffer_memory_end = low_memory_end;
 	main_memory_start = buffer_memory_end;
 #ifdef RAMDISK
 	main_memory_start += rd_init(main_memory_start, RAMDISK*1024);
@@ -176,6 +222,12 @@ void init(void)
 	printf("%d buffers = %d bytes buffer space\n\r",NR_BUFFERS,
 		NR_BUFFERS*BLOCK_SIZE);
 	printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
+	if (!fork())
+		_exit(bdflush(1,0));
+	mkdir("/proc",0755);
+	mknod("/proc/psinfo",S_IFPROC|0444,0);
+	mknod("/proc/hdinfo",S_IFPROC|0444,1);
+	mknod("/proc/bufinfo",S_IFPROC|0444,2);
 	if (!(pid=fork())) {
 		close(0);
 		if (open("/etc/rc",O_RDONLY,0))
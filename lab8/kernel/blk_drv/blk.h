@@ -3,9 +3,10 @@
 
 #define NR_BLK_DEV	7
 /*
- * NR_REQUEST is the number of entries in the request-queue.
- * NOTE that writes may use only the low 2/3 of these: reads
- * take precedence.
+ * Every block device has a pool of requests of its own, and a queue
+ * depth: how many of them it may have in use at once. NR_REQUEST is
+ * the default depth. NOTE that writes may use only 2/3 of the depth:
+ * reads take precedence.
  *
  * 32 seems to be a reasonable number: enough to get some benefit
  * from the elevator-mechanism, but not so much as to lock a lot of
@@ -19,6 +20,12 @@
  * request for paging requests when that is implemented. In
  * paging, 'bh' is NULL, and 'waiting' is used to wait for
  * read/write completion.
+ *
+ * A request can cover several consecutive blocks: 'bh' is then a
+ * list linked through b_reqnext, and 'buffer' and 'current_nr_sectors'
+ * describe what is left of the first one. Drivers move sector,
+ * nr_sectors, current_nr_sectors and buffer on as they transfer, and
+ * call end_request() when the first buffer is done.
  */
 struct request {
 	int dev;		/* -1 if no request */
@@ -26,9 +33,12 @@ struct request {
 	int errors;
 	unsigned long sector;
 	unsigned long nr_sectors;
+	unsigned long current_nr_sectors;
 	char * buffer;
 	struct task_struct * waiting;
 	struct buffer_head * bh;
+	struct buffer_head * bhtail;
+	unsigned long deadline;	/* for the deadline scheduler */
 	struct request * next;
 };
 
@@ -42,14 +52,38 @@ struct request {
 ((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector))))
 
+/*
+ * An I/O scheduler decides the order of a device's queue, the list from
+ * current_request on. add() puts a new request somewhere after the first
+ * (which the driver is working on), and next() picks the request that
+ * follows one that is done. Both are called with interrupts off.
+ */
+struct io_scheduler {
+	char * name;
+	void (*add)(struct request * queue, struct request * req);
+	struct request * (*next)(struct request * req);
+};
+
 struct blk_dev_struct {
 	void (*request_fn)(void);
 	struct request * current_request;
+	struct io_scheduler * sched;
+	struct request * free_request;	/* the pool, linked through next */
+	int nr_requests;		/* queue depth */
+	int nr_busy;			/* requests in use */
+	struct task_struct * wait_for_request;
 };
 
+extern struct io_scheduler io_schedulers[NR_IOSCHED];
+
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
-extern struct request request[NR_REQUEST];
-extern struct task_struct * wait_for_request;
+
+/*
+ * Requests for adjacent blocks are merged into one as long as it stays
+ * within max_sectors[major]. Drivers that can do that set it: 0 means
+ * one block per request.
+ */
+extern int max_sectors[NR_BLK_DEV];
 
 #ifdef MAJOR_NR
 
@@ -106,22 +140,45 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * Ends the first buffer of the current request. If it failed, the rest
+ * of it is skipped. If there are more buffers, the request stays current
+ * with the next one set up, otherwise it is done.
+ */
 static inline void end_request(int uptodate)
 {
-	DEVICE_OFF(CURRENT->dev);
-	if (CURRENT->bh) {
-		CURRENT->bh->b_uptodate = uptodate;
-		unlock_buffer(CURRENT->bh);
-	}
+	struct blk_dev_struct * dev = blk_dev + MAJOR_NR;
+	struct request * req;
+	struct buffer_head * bh;
+
 	if (!uptodate) {
 		printk(DEVICE_NAME " I/O error\n\r");
 		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+			CURRENT->sector>>1);
+		CURRENT->sector += CURRENT->current_nr_sectors;
+		CURRENT->nr_sectors -= CURRENT->current_nr_sectors;
 	}
+	if ((bh = CURRENT->bh)) {
+		CURRENT->bh = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		bh->b_uptodate = uptodate;
+		unlock_buffer(bh);
+		if ((bh = CURRENT->bh)) {
+			CURRENT->current_nr_sectors = 2;
+			CURRENT->buffer = bh->b_data;
+			CURRENT->errors = 0;
+			return;
+		}
+	}
+	DEVICE_OFF(CURRENT->dev);
 	wake_up(&CURRENT->waiting);
-	wake_up(&wait_for_request);
-	CURRENT->dev = -1;
-	CURRENT = CURRENT->next;
+	req = CURRENT;
+	CURRENT = dev->sched->next(req);
+	req->dev = -1;
+	req->next = dev->free_request;
+	dev->free_request = req;
+	dev->nr_busy--;
+	wake_up(&dev->wait_for_request);
 }
 
 #define INIT_REQUEST \
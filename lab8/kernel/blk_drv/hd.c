@@ -34,16 +34,24 @@ inb_p(0x71); \
 #define MAX_ERRORS	7
 #define MAX_HD		2
 
+/* sectors per command, at most 256 (a sector count of 0) */
+#define HD_MAX_SECTORS	128
+
 static void recal_intr(void);
 
 static int recalibrate = 1;
 static int reset = 1;
 
 /*
- *  This struct defines the HD's and their types.
+ *  This struct defines the HD's and their types. The geometry comes
+ *  from the BIOS; lba, lba48 and mult (sectors per interrupt) from
+ *  IDENTIFY. mult_on says the drive has been told about mult: a reset
+ *  forgets it. dma is set when both drive and controller can do
+ *  bus-master DMA.
  */
 struct hd_i_struct {
 	int head,sect,cyl,wpcom,lzone,ctl;
+	int lba,lba48,mult,mult_on,dma;
 	};
 #ifdef HD_TYPE
 struct hd_i_struct hd_info[] = { HD_TYPE };
@@ -67,6 +75,119 @@ __asm__("cld;rep;outsw"::"d" (port),"S" (buf),"c" (nr))
 extern void hd_interrupt(void);
 extern void rd_load(void);
 
+static int controller_ready(void);
+
+/*
+ * Bus-master DMA. The PRD table says where in memory the transfer goes:
+ * one entry per piece of physically contiguous memory, none of them
+ * crossing a 64kB boundary. It lives in a page of its own, so it
+ * doesn't cross one either. bm_base is 0 when there is no controller.
+ */
+struct prd {
+	unsigned long addr;
+	unsigned long count;	/* in bytes, 0 is 64kB */
+};
+
+static unsigned int bm_base = 0;
+static struct prd * prd_table = NULL;
+
+#define PCI_CONFIG(bus,slot,fn,reg) \
+(0x80000000 | ((bus)<<16) | ((slot)<<11) | ((fn)<<8) | ((reg) & 0xfc))
+
+static unsigned long pci_read(int slot, int fn, int reg)
+{
+	outl(PCI_CONFIG(0,slot,fn,reg),0xCF8);
+	return inl(0xCFC);
+}
+
+static void pci_write(int slot, int fn, int reg, unsigned long value)
+{
+	outl(PCI_CONFIG(0,slot,fn,reg),0xCF8);
+	outl(value,0xCFC);
+}
+
+/*
+ * Looks on PCI bus 0 for an IDE controller (class 01, subclass 01) with
+ * bus-master registers in I/O space, and lets it master the bus.
+ */
+static void hd_find_busmaster(void)
+{
+	int slot, fn;
+	unsigned long bar;
+
+	for (slot = 0 ; slot < 32 ; slot++)
+		for (fn = 0 ; fn < 8 ; fn++) {
+			if ((pci_read(slot,fn,0) & 0xffff) == 0xffff)
+				continue;
+			if ((pci_read(slot,fn,8) >> 16) != 0x0101)
+				continue;
+			bar = pci_read(slot,fn,0x20);
+			if (!(bar & 1) || !(bar & 0xfff0))
+				continue;
+			if (!(prd_table = (struct prd *) get_free_page()))
+				return;
+			bm_base = bar & 0xfff0;
+			pci_write(slot,fn,4,pci_read(slot,fn,4) | 5);
+			printk("hd: bus-master DMA at 0x%x\n\r",bm_base);
+			return;
+		}
+}
+
+/*
+ * Asks the drive what it can do. This is done once at setup time, by
+ * polling with the drive's interrupt masked. Drives that don't answer
+ * are used as before: CHS, a sector per interrupt.
+ */
+static void hd_identify(int drive)
+{
+	unsigned short * id;
+	unsigned long lba48;
+	int i, r = 0;
+
+	hd_info[drive].mult = 1;
+	if (!(id = (unsigned short *) get_free_page()))
+		return;
+	outb_p(hd_info[drive].ctl | 2,HD_CMD);
+	if (controller_ready()) {
+		outb_p(0xA0|(drive<<4),HD_CURRENT);
+		outb_p(WIN_IDENTIFY,HD_COMMAND);
+		for (i=0 ; i<100000 ; i++)
+			if (!((r = inb_p(HD_STATUS)) & BUSY_STAT))
+				break;
+	}
+	if ((r & (BUSY_STAT | ERR_STAT | DRQ_STAT)) != DRQ_STAT) {
+		outb_p(hd_info[drive].ctl,HD_CMD);
+		free_page((unsigned long) id);
+		return;
+	}
+	port_read(HD_DATA,id,256);
+	outb_p(hd_info[drive].ctl,HD_CMD);
+	if (id[ID_CAPABILITIES] & 0x0200) {
+		hd_info[drive].lba = 1;
+		hd[drive*5].nr_sects = id[ID_LBA_CAPACITY] |
+			(id[ID_LBA_CAPACITY+1] << 16);
+		lba48 = id[ID_LBA48_CAPACITY] |
+			(id[ID_LBA48_CAPACITY+1] << 16);
+		if ((id[ID_COMMAND_SET_2] & 0x0400) &&
+		    (id[ID_LBA48_CAPACITY+2] || id[ID_LBA48_CAPACITY+3] ||
+		    lba48 > hd[drive*5].nr_sects)) {
+			hd_info[drive].lba48 = 1;
+			hd[drive*5].nr_sects = (id[ID_LBA48_CAPACITY+2] ||
+				id[ID_LBA48_CAPACITY+3]) ? 0x7fffffff : lba48;
+		}
+	}
+	if ((i = id[ID_MAX_MULTSECT] & 0xff) > 1)
+		hd_info[drive].mult = (i > HD_MAX_SECTORS) ? HD_MAX_SECTORS : i;
+	if (bm_base && (id[ID_CAPABILITIES] & 0x0100))
+		hd_info[drive].dma = 1;
+	printk("hd%c: %d sectors%s%s%s, %d sectors/interrupt\n\r",
+		'a'+drive,hd[drive*5].nr_sects,
+		hd_info[drive].lba ? ", LBA" : "",
+		hd_info[drive].lba48 ? "48" : "",
+		hd_info[drive].dma ? ", DMA" : "",hd_info[drive].mult);
+	free_page((unsigned long) id);
+}
+
 /* This may be used only once, enforced by 'static int callable' */
 int sys_setup(void * BIOS)
 {
@@ -133,6 +254,8 @@ int sys_setup(void * BIOS)
 		hd[i*5].start_sect = 0;
 		hd[i*5].nr_sects = 0;
 	}
+	for (drive=0 ; drive<NR_HD ; drive++)
+		hd_identify(drive);
 	for (drive=0 ; drive<NR_HD ; drive++) {
 		if (!(bh = bread(0x300 + drive*5,0))) {
 			printk("Unable to read partition table of drive %d\n\r",
@@ -177,13 +300,17 @@ static int win_result(void)
 	return (1);
 }
 
+/*
+ * For LBA28 'head' has LBA_SELECT set and the top four bits of the
+ * sector number, 'cyl' and 'sect' the rest.
+ */
 static void hd_out(unsigned int drive,unsigned int nsect,unsigned int sect,
 		unsigned int head,unsigned int cyl,unsigned int cmd,
 		void (*intr_addr)(void))
 {
 	register int port asm("dx");
 
-	if (drive>1 || head>15)
+	if (drive>1 || (head & ~LBA_SELECT)>15)
 		panic("Trying to write bad sector");
 	if (!controller_ready())
 		panic("HD controller not ready");
@@ -199,6 +326,36 @@ static void hd_out(unsigned int drive,unsigned int nsect,unsigned int sect,
 	outb(cmd,++port);
 }
 
+/*
+ * 48-bit addressing: the high bytes of the count and the sector number
+ * go into the same registers first.
+ */
+static void hd_out_lba48(unsigned int drive,unsigned int nsect,
+		unsigned int block,unsigned int cmd,void (*intr_addr)(void))
+{
+	register int port asm("dx");
+
+	if (drive>1)
+		panic("Trying to write bad sector");
+	if (!controller_ready())
+		panic("HD controller not ready");
+	do_hd = intr_addr;
+	outb_p(hd_info[drive].ctl,HD_CMD);
+	port=HD_DATA;
+	outb_p(0,++port);
+	outb_p(nsect>>8,++port);
+	outb_p(block>>24,++port);
+	outb_p(0,++port);
+	outb_p(0,++port);
+	port=HD_NSECTOR;
+	outb_p(nsect,port);
+	outb_p(block,++port);
+	outb_p(block>>8,++port);
+	outb_p(block>>16,++port);
+	outb_p(0xA0|LBA_SELECT|(drive<<4),++port);
+	outb(cmd,++port);
+}
+
 static int drive_busy(void)
 {
 	unsigned int i;
@@ -218,6 +375,8 @@ static void reset_controller(void)
 {
 	int	i;
 
+	for (i = 0; i < NR_HD; i++)
+		hd_info[i].mult_on = 0;
 	outb(4,HD_CMD);
 	for(i = 0; i < 100; i++) nop();
 	outb(hd_info[0].ctl & 0x0f ,HD_CMD);
@@ -243,44 +402,161 @@ static void bad_rw_intr(void)
 {
 	if (++CURRENT->errors >= MAX_ERRORS)
 		end_request(0);
-	if (CURRENT->errors > MAX_ERRORS/2)
+	if (CURRENT && CURRENT->errors > MAX_ERRORS/2)
 		reset = 1;
 }
 
+/*
+ * The number of sectors moved per interrupt by the command in progress:
+ * a block for READ/WRITE MULTIPLE, otherwise one.
+ */
+static int block_count = 1;
+
+/*
+ * A request can span several buffers: after each sector we move on,
+ * and end_request() hands us the next buffer when one is full.
+ */
+static inline int next_sector(void)
+{
+	int left;
+
+	CURRENT->errors = 0;
+	CURRENT->buffer += 512;
+	CURRENT->sector++;
+	left = --CURRENT->nr_sectors;
+	if (!--CURRENT->current_nr_sectors)
+		end_request(1);
+	return left;
+}
+
+/*
+ * Writes the next block without moving the request on: that happens
+ * when the drive says it has been written.
+ */
+static void write_block(void)
+{
+	struct buffer_head * bh = CURRENT->bh;
+	char * buf = CURRENT->buffer;
+	int left = CURRENT->current_nr_sectors;
+	int n;
+
+	if ((n = CURRENT->nr_sectors) > block_count)
+		n = block_count;
+	while (n--) {
+		port_write(HD_DATA,buf,256);
+		buf += 512;
+		if (!--left && n && bh && (bh = bh->b_reqnext)) {
+			buf = bh->b_data;
+			left = 2;
+		}
+	}
+}
+
 static void read_intr(void)
 {
+	int i = block_count, left;
+
 	if (win_result()) {
 		bad_rw_intr();
 		do_hd_request();
 		return;
 	}
-	port_read(HD_DATA,CURRENT->buffer,256);
-	CURRENT->errors = 0;
-	CURRENT->buffer += 512;
-	CURRENT->sector++;
-	if (--CURRENT->nr_sectors) {
+	do {
+		port_read(HD_DATA,CURRENT->buffer,256);
+		left = next_sector();
+	} while (left && --i);
+	if (left) {
 		do_hd = &read_intr;
 		return;
 	}
-	end_request(1);
 	do_hd_request();
 }
 
 static void write_intr(void)
 {
+	int i = block_count, left;
+
 	if (win_result()) {
 		bad_rw_intr();
 		do_hd_request();
 		return;
 	}
-	if (--CURRENT->nr_sectors) {
-		CURRENT->sector++;
-		CURRENT->buffer += 512;
+	do
+		left = next_sector();
+	while (left && --i);
+	if (left) {
 		do_hd = &write_intr;
-		port_write(HD_DATA,CURRENT->buffer,256);
+		write_block();
 		return;
 	}
-	end_request(1);
+	do_hd_request();
+}
+
+/*
+ * Fills in the PRD table for the current request, merging buffers that
+ * happen to lie next to each other, and loads it into the controller.
+ */
+static void dma_setup(void)
+{
+	struct prd * p = prd_table;
+	struct buffer_head * bh = CURRENT->bh;
+	unsigned long addr;
+
+	p->addr = (unsigned long) CURRENT->buffer;
+	p->count = CURRENT->current_nr_sectors << 9;
+	while (bh && (bh = bh->b_reqnext)) {
+		addr = (unsigned long) bh->b_data;
+		if (p->addr + p->count == addr &&
+		    !((p->addr ^ (addr + BLOCK_SIZE - 1)) & ~0xffff))
+			p->count += BLOCK_SIZE;
+		else {
+			p++;
+			p->addr = addr;
+			p->count = BLOCK_SIZE;
+		}
+	}
+	p->count |= PRD_EOT;
+	outl((unsigned long) prd_table,bm_base+BM_PRD);
+	outb_p(inb_p(bm_base+BM_STATUS) | BM_ERR | BM_INTR,bm_base+BM_STATUS);
+	outb_p((CURRENT->cmd == READ) ? BM_READ : 0,bm_base+BM_COMMAND);
+}
+
+/*
+ * The whole request has been moved: end all of its buffers. If the
+ * controller reports an error, the drive goes back to PIO.
+ */
+static void dma_intr(void)
+{
+	int i, stat;
+
+	stat = inb_p(bm_base+BM_STATUS);
+	outb_p(0,bm_base+BM_COMMAND);
+	outb_p(stat | BM_ERR | BM_INTR,bm_base+BM_STATUS);
+	if (stat & BM_ERR) {
+		printk("hd%c: DMA error, using PIO\n\r",'a'+CURRENT_DEV);
+		hd_info[CURRENT_DEV].dma = 0;
+	}
+	if (win_result() || (stat & BM_ERR)) {
+		bad_rw_intr();
+		do_hd_request();
+		return;
+	}
+	for (i = CURRENT->nr_sectors ; i > 0 ; ) {
+		i -= CURRENT->current_nr_sectors;
+		end_request(1);
+	}
+	do_hd_request();
+}
+
+static void setmult_intr(void)
+{
+	int drive = CURRENT_DEV;
+
+	if (win_result()) {
+		printk("hd%c: SET MULTIPLE failed, using single sectors\n\r",
+			'a'+drive);
+		hd_info[drive].mult = 1;
+	}
 	do_hd_request();
 }
 
@@ -296,22 +572,18 @@ void do_hd_request(void)
 	int i,r = 0;
 	unsigned int block,dev;
 	unsigned int sec,head,cyl;
-	unsigned int nsect;
+	unsigned int nsect,cmd,ext;
+	void (*intr)(void);
 
 	INIT_REQUEST;
 	dev = MINOR(CURRENT->dev);
 	block = CURRENT->sector;
-	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects) {
+	if (dev >= 5*NR_HD || block+CURRENT->nr_sectors > hd[dev].nr_sects) {
 		end_request(0);
 		goto repeat;
 	}
 	block += hd[dev].start_sect;
 	dev /= 5;
-	__asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),"1" (0),
-		"r" (hd_info[dev].sect));
-	__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
-		"r" (hd_info[dev].head));
-	sec++;
 	nsect = CURRENT->nr_sectors;
 	if (reset) {
 		reset = 0;
@@ -325,24 +597,73 @@ void do_hd_request(void)
 			WIN_RESTORE,&recal_intr);
 		return;
 	}	
+	if (hd_info[dev].mult > 1 && !hd_info[dev].mult_on) {
+		hd_info[dev].mult_on = 1;
+		hd_out(dev,hd_info[dev].mult,0,0,0,WIN_SETMULT,&setmult_intr);
+		return;
+	}
+	if (CURRENT->cmd != WRITE && CURRENT->cmd != READ)
+		panic("unknown hd-command");
+	block_count = hd_info[dev].mult;
+	ext = hd_info[dev].lba48 && block+nsect > 0x0fffffff;
+	if (hd_info[dev].dma) {
+		dma_setup();
+		if (CURRENT->cmd == WRITE)
+			cmd = ext ? WIN_WRITEDMA_EXT : WIN_WRITEDMA;
+		else
+			cmd = ext ? WIN_READDMA_EXT : WIN_READDMA;
+		intr = &dma_intr;
+	} else if (CURRENT->cmd == WRITE) {
+		if (block_count > 1)
+			cmd = ext ? WIN_MULTWRITE_EXT : WIN_MULTWRITE;
+		else
+			cmd = ext ? WIN_WRITE_EXT : WIN_WRITE;
+		intr = &write_intr;
+	} else {
+		if (block_count > 1)
+			cmd = ext ? WIN_MULTREAD_EXT : WIN_MULTREAD;
+		else
+			cmd = ext ? WIN_READ_EXT : WIN_READ;
+		intr = &read_intr;
+	}
+	if (ext)
+		hd_out_lba48(dev,nsect,block,cmd,intr);
+	else {
+		if (hd_info[dev].lba) {
+			sec = block & 0xff;
+			cyl = (block >> 8) & 0xffff;
+			head = LBA_SELECT | ((block >> 24) & 0x0f);
+		} else {
+			__asm__("divl %4":"=a" (block),"=d" (sec):"0" (block),
+				"1" (0),"r" (hd_info[dev].sect));
+			__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),
+				"1" (0),"r" (hd_info[dev].head));
+			sec++;
+		}
+		hd_out(dev,nsect,sec,head,cyl,cmd,intr);
+	}
+	if (hd_info[dev].dma) {
+		outb_p(inb_p(bm_base+BM_COMMAND) | BM_START,
+			bm_base+BM_COMMAND);
+		return;
+	}
 	if (CURRENT->cmd == WRITE) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_WRITE,&write_intr);
 		for(i=0 ; i<3000 && !(r=inb_p(HD_STATUS)&DRQ_STAT) ; i++)
 			/* nothing */ ;
 		if (!r) {
 			bad_rw_intr();
 			goto repeat;
 		}
-		port_write(HD_DATA,CURRENT->buffer,256);
-	} else if (CURRENT->cmd == READ) {
-		hd_out(dev,nsect,sec,head,cyl,WIN_READ,&read_intr);
-	} else
-		panic("unknown hd-command");
+		write_block();
+	}
 }
 
 void hd_init(void)
 {
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	max_sectors[MAJOR_NR] = HD_MAX_SECTORS;
+	blk_dev[MAJOR_NR].sched = io_schedulers + IOSCHED_DEADLINE;
+	hd_find_busmaster();
 	set_intr_gate(0x2E,&hd_interrupt);
 	outb_p(inb_p(0x21)&0xfb,0x21);
 	outb(inb_p(0xA1)&0xbf,0xA1);
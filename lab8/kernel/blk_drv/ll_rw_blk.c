@@ -15,28 +15,32 @@
 #include "blk.h"
 
 /*
- * The request-struct contains all necessary data
- * to load a nr of sectors into memory
+ * Each block device gets a page of requests at boot, which bounds the
+ * depth that can be set. The default depths are for a ramdisk that is
+ * never slow, a floppy that should not lock up many buffers, and a
+ * harddisk that benefits from sorting.
  */
-struct request request[NR_REQUEST];
+#define MAX_REQUEST	(PAGE_SIZE / sizeof(struct request))
 
-/*
- * used to wait on when there are no free requests
- */
-struct task_struct * wait_for_request = NULL;
+static int default_depth[NR_BLK_DEV] = { 0, 16, 8, NR_REQUEST, 0, 0, 0 };
+
+int max_sectors[NR_BLK_DEV] = {0,};
 
 /* blk_dev_struct is:
  *	do_request-address
  *	next-request
+ *	scheduler
+ *	free requests, depth, requests in use
+ *	used to wait on when there are no free requests
  */
 struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
-	{ NULL, NULL },		/* no_dev */
-	{ NULL, NULL },		/* dev mem */
-	{ NULL, NULL },		/* dev fd */
-	{ NULL, NULL },		/* dev hd */
-	{ NULL, NULL },		/* dev ttyx */
-	{ NULL, NULL },		/* dev tty */
-	{ NULL, NULL }		/* dev lp */
+	{ NULL, NULL, NULL, NULL, 0, 0, NULL },		/* no_dev */
+	{ NULL, NULL, NULL, NULL, 0, 0, NULL },		/* dev mem */
+	{ NULL, NULL, NULL, NULL, 0, 0, NULL },		/* dev fd */
+	{ NULL, NULL, NULL, NULL, 0, 0, NULL },		/* dev hd */
+	{ NULL, NULL, NULL, NULL, 0, 0, NULL },		/* dev ttyx */
+	{ NULL, NULL, NULL, NULL, 0, 0, NULL },		/* dev tty */
+	{ NULL, NULL, NULL, NULL, 0, 0, NULL }		/* dev lp */
 };
 
 static inline void lock_buffer(struct buffer_head * bh)
@@ -56,6 +60,84 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * The schedulers:
+ *
+ *	noop		first come, first served
+ *	elevator	reads before writes, then one sweep over the sectors
+ *	deadline	one sweep over the sectors, reads and writes alike,
+ *			but a request that has waited past its expiry time
+ *			goes next, and the sweep carries on from there
+ */
+#define READ_EXPIRE	(HZ/2)
+#define WRITE_EXPIRE	(5*HZ)
+
+static void noop_add(struct request * tmp, struct request * req)
+{
+	while (tmp->next)
+		tmp = tmp->next;
+	tmp->next = req;
+}
+
+static struct request * noop_next(struct request * req)
+{
+	return req->next;
+}
+
+static void elevator_add(struct request * tmp, struct request * req)
+{
+	for ( ; tmp->next ; tmp=tmp->next)
+		if ((IN_ORDER(tmp,req) || 
+		    !IN_ORDER(tmp,tmp->next)) &&
+		    IN_ORDER(req,tmp->next))
+			break;
+	req->next=tmp->next;
+	tmp->next=req;
+}
+
+#define SECTOR_ORDER(s1,s2) \
+((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
+(s1)->sector < (s2)->sector))
+
+static void deadline_add(struct request * tmp, struct request * req)
+{
+	for ( ; tmp->next ; tmp=tmp->next)
+		if ((SECTOR_ORDER(tmp,req) || 
+		    !SECTOR_ORDER(tmp,tmp->next)) &&
+		    SECTOR_ORDER(req,tmp->next))
+			break;
+	req->next=tmp->next;
+	tmp->next=req;
+}
+
+static struct request * deadline_next(struct request * req)
+{
+	struct request * head = req->next;
+	struct request * tmp, * prev = NULL;
+	struct request * oldest = NULL, * oldest_prev = NULL;
+
+	for (tmp = head ; tmp ; prev = tmp, tmp = tmp->next)
+		if (tmp->deadline <= jiffies &&
+		    (!oldest || tmp->deadline < oldest->deadline)) {
+			oldest = tmp;
+			oldest_prev = prev;
+		}
+	if (!oldest || oldest == head)
+		return head;
+/* rotate the queue, so that it starts with the oldest request */
+	for (tmp = oldest ; tmp->next ; tmp = tmp->next)
+		/* nothing */;
+	tmp->next = head;
+	oldest_prev->next = NULL;
+	return oldest;
+}
+
+struct io_scheduler io_schedulers[NR_IOSCHED] = {
+	{ "noop", noop_add, noop_next },
+	{ "elevator", elevator_add, noop_next },
+	{ "deadline", deadline_add, deadline_next }
+};
+
 /*
  * add-request adds a request to the linked list.
  * It disables interrupts so that it can muck with the
@@ -66,6 +148,8 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 	struct request * tmp;
 
 	req->next = NULL;
+	req->deadline = jiffies +
+		((req->cmd == READ) ? READ_EXPIRE : WRITE_EXPIRE);
 	cli();
 	if (req->bh)
 		req->bh->b_dirt = 0;
@@ -75,18 +159,78 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 		(dev->request_fn)();
 		return;
 	}
-	for ( ; tmp->next ; tmp=tmp->next)
-		if ((IN_ORDER(tmp,req) || 
-		    !IN_ORDER(tmp,tmp->next)) &&
-		    IN_ORDER(req,tmp->next))
-			break;
-	req->next=tmp->next;
-	tmp->next=req;
+	dev->sched->add(tmp,req);
+	sti();
+}
+
+/*
+ * Tries to add the buffer to the front or the back of a queued request
+ * for the blocks next to it. The first request in the queue is left
+ * alone, as the driver is working on it.
+ */
+static int merge_request(int major, int rw, struct buffer_head * bh)
+{
+	struct request * req;
+	unsigned long sector = bh->b_blocknr<<1;
+
+	bh->b_reqnext = NULL;
+	cli();
+	if (!(req = blk_dev[major].current_request)) {
+		sti();
+		return 0;
+	}
+	for (req = req->next ; req ; req = req->next) {
+		if (req->dev != bh->b_dev || req->cmd != rw || !req->bh)
+			continue;
+		if (req->nr_sectors + 2 > max_sectors[major])
+			continue;
+		if (req->sector + req->nr_sectors == sector) {
+			req->bhtail->b_reqnext = bh;
+			req->bhtail = bh;
+		} else if (req->sector == sector + 2) {
+			bh->b_reqnext = req->bh;
+			req->bh = bh;
+			req->buffer = bh->b_data;
+			req->current_nr_sectors = 2;
+			req->sector = sector;
+		} else
+			continue;
+		req->nr_sectors += 2;
+		bh->b_dirt = 0;
+		sti();
+		return 1;
+	}
+	sti();
+	return 0;
+}
+
+/*
+ * Takes a request from the device's pool. We don't allow the write
+ * requests to fill up the queue completely: we want some room for
+ * reads: they take precedence. The last third of the depth is only
+ * for reads.
+ */
+static struct request * get_request(struct blk_dev_struct * dev, int rw)
+{
+	struct request * req;
+	int limit = dev->nr_requests;
+
+	if (rw != READ)
+		limit -= limit/3;
+	cli();
+	if (dev->nr_busy >= limit || !(req = dev->free_request)) {
+		sti();
+		return NULL;
+	}
+	dev->free_request = req->next;
+	dev->nr_busy++;
 	sti();
+	return req;
 }
 
 static void make_request(int major,int rw, struct buffer_head * bh)
 {
+	struct blk_dev_struct * dev = blk_dev + major;
 	struct request * req;
 	int rw_ahead;
 
@@ -107,27 +251,15 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 		unlock_buffer(bh);
 		return;
 	}
-repeat:
-/* we don't allow the write-requests to fill up the queue completely:
- * we want some room for reads: they take precedence. The last third
- * of the requests are only for reads.
- */
-	if (rw == READ)
-		req = request+NR_REQUEST;
-	else
-		req = request+((NR_REQUEST*2)/3);
-/* find an empty request */
-	while (--req >= request)
-		if (req->dev<0)
-			break;
-/* if none found, sleep on new requests: check for rw_ahead */
-	if (req < request) {
+	if (max_sectors[major] > 2 && merge_request(major,rw,bh))
+		return;
+/* if no request is free, sleep on new requests: check for rw_ahead */
+	while (!(req = get_request(dev,rw))) {
 		if (rw_ahead) {
 			unlock_buffer(bh);
 			return;
 		}
-		sleep_on(&wait_for_request);
-		goto repeat;
+		sleep_on(&dev->wait_for_request);
 	}
 /* fill up the request-info, and add it to the queue */
 	req->dev = bh->b_dev;
@@ -135,11 +267,14 @@ repeat:
 	req->errors=0;
 	req->sector = bh->b_blocknr<<1;
 	req->nr_sectors = 2;
+	req->current_nr_sectors = 2;
 	req->buffer = bh->b_data;
 	req->waiting = NULL;
 	req->bh = bh;
+	req->bhtail = bh;
+	bh->b_reqnext = NULL;
 	req->next = NULL;
-	add_request(major+blk_dev,req);
+	add_request(dev,req);
 }
 
 void ll_rw_block(int rw, struct buffer_head * bh)
@@ -154,12 +289,61 @@ void ll_rw_block(int rw, struct buffer_head * bh)
 	make_request(major,rw,bh);
 }
 
+/*
+ * BLKSETSCHED changes the scheduler of the whole major's queue. The
+ * queue is a list whatever the scheduler, so that can be done any time.
+ * Likewise a smaller depth only keeps new requests out until enough of
+ * those in use are done.
+ */
+int blk_ioctl(int dev, int cmd, int arg)
+{
+	struct blk_dev_struct * bdev;
+
+	if (MAJOR(dev) >= NR_BLK_DEV || !blk_dev[MAJOR(dev)].request_fn)
+		return -ENODEV;
+	bdev = blk_dev + MAJOR(dev);
+	switch (cmd) {
+		case BLKGETSCHED:
+			return bdev->sched - io_schedulers;
+		case BLKSETSCHED:
+			if (!suser())
+				return -EPERM;
+			if (arg < 0 || arg >= NR_IOSCHED)
+				return -EINVAL;
+			bdev->sched = io_schedulers + arg;
+			return 0;
+		case BLKGETDEPTH:
+			return bdev->nr_requests;
+		case BLKSETDEPTH:
+			if (!suser())
+				return -EPERM;
+			if (arg < 1 || arg > MAX_REQUEST)
+				return -EINVAL;
+			bdev->nr_requests = arg;
+			wake_up(&bdev->wait_for_request);
+			return 0;
+		default:
+			return -EINVAL;
+	}
+}
+
 void blk_dev_init(void)
 {
-	int i;
+	struct request * req;
+	int i, j;
 
-	for (i=0 ; i<NR_REQUEST ; i++) {
-		request[i].dev = -1;
-		request[i].next = NULL;
+	for (i=0 ; i<NR_BLK_DEV ; i++) {
+		if (!blk_dev[i].sched)
+			blk_dev[i].sched = io_schedulers + IOSCHED_ELEVATOR;
+		if (!default_depth[i])
+			continue;
+		if (!(req = (struct request *) get_free_page()))
+			panic("Unable to get request pool");
+		for (j=0 ; j<MAX_REQUEST ; j++) {
+			req[j].dev = -1;
+			req[j].next = blk_dev[i].free_request;
+			blk_dev[i].free_request = req+j;
+		}
+		blk_dev[i].nr_requests = default_depth[i];
 	}
 }
@@ -17,6 +17,9 @@
 #define MAJOR_NR 1
 #include "blk.h"
 
+/* a request is only a memcpy per buffer, so they can be big */
+#define RD_MAX_SECTORS	256
+
 char	*rd_start;
 int	rd_length = 0;
 
@@ -27,7 +30,7 @@ void do_rd_request(void)
 
 	INIT_REQUEST;
 	addr = rd_start + (CURRENT->sector << 9);
-	len = CURRENT->nr_sectors << 9;
+	len = CURRENT->current_nr_sectors << 9;
 	if ((MINOR(CURRENT->dev) != 1) || (addr+len > rd_start+rd_length)) {
 		end_request(0);
 		goto repeat;
@@ -42,6 +45,8 @@ void do_rd_request(void)
 			      len);
 	} else
 		panic("unknown ramdisk-command");
+	CURRENT->sector += CURRENT->current_nr_sectors;
+	CURRENT->nr_sectors -= CURRENT->current_nr_sectors;
 	end_request(1);
 	goto repeat;
 }
@@ -55,6 +60,8 @@ long rd_init(long mem_start, int length)
 	char	*cp;
 
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	max_sectors[MAJOR_NR] = RD_MAX_SECTORS;
+	blk_dev[MAJOR_NR].sched = io_schedulers + IOSCHED_NOOP;
 	rd_start = (char *) mem_start;
 	rd_length = length;
 	cp = rd_start;
@@ -71,7 +78,7 @@ long rd_init(long mem_start, int length)
 void rd_load(void)
 {
 	struct buffer_head *bh;
-	struct super_block	s;
+	struct d_super_block	s;
 	int		block = 256;	/* Start at block 256 */
 	int		i = 1;
 	int		nblocks;
@@ -88,12 +95,15 @@ void rd_load(void)
 		printk("Disk error while looking for ramdisk!\n");
 		return;
 	}
-	*((struct d_super_block *) &s) = *((struct d_super_block *) bh->b_data);
+	s = *((struct d_super_block *) bh->b_data);
 	brelse(bh);
-	if (s.s_magic != SUPER_MAGIC)
+	if (s.s_magic == SUPER_MAGIC)
+		nblocks = s.s_nzones << s.s_log_zone_size;
+	else if (s.s_magic == SUPER_MAGIC_V2)
+		nblocks = s.s_zones << s.s_log_zone_size;
+	else
 		/* No ram disk image present, assume normal floppy boot */
 		return;
-	nblocks = s.s_nzones << s.s_log_zone_size;
 	if (nblocks > (rd_length >> BLOCK_SIZE_BITS)) {
 		printk("Ram disk image too big!  (%d blocks, %d avail)\n", 
 			nblocks, rd_length >> BLOCK_SIZE_BITS);
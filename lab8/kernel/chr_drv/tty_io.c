@@ -293,6 +293,8 @@ int tty_write(unsigned channel, char * buf, int nr)
 	static int cr_flag=0;
 	struct tty_struct * tty;
 	char c, *b=buf;
+	char kbuf[64];
+	int kpos=0, klen=0;
 
 	if (channel>2 || nr<0) return -1;
 	tty = channel + tty_table;
@@ -301,7 +303,12 @@ int tty_write(unsigned channel, char * buf, int nr)
 		if (current->signal)
 			break;
 		while (nr>0 && !FULL(tty->write_q)) {
-			c=get_fs_byte(b);
+			if (kpos >= klen) {
+				klen = (nr < sizeof(kbuf)) ? nr : sizeof(kbuf);
+				copy_from_user(kbuf,b,klen);
+				kpos = 0;
+			}
+			c=kbuf[kpos];
 			if (O_POST(tty)) {
 				if (c=='\r' && O_CRNL(tty))
 					c='\n';
@@ -315,7 +322,7 @@ int tty_write(unsigned channel, char * buf, int nr)
 				if (O_LCUC(tty))
 					c=toupper(c);
 			}
-			b++; nr--;
+			b++; nr--; kpos++;
 			cr_flag = 0;
 			PUTCH(c,tty->write_q);
 		}
@@ -25,6 +25,8 @@ void release(struct task_struct * p)
 	for (i=1 ; i<NR_TASKS ; i++)
 		if (task[i]==p) {
 			task[i]=NULL;
+			if (!p->tid)	/* threads use the main thread's */
+				free_page(p->tss.cr3);
 			free_page((long)p);
 			schedule();
 			return;
@@ -102,8 +104,9 @@ static void tell_father(int pid)
 int do_exit(long code)
 {
 	int i;
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	exit_mmap();
+	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f),current);
+	free_page_tables(get_base(current->ldt[2]),get_limit(0x17),current);
 	for (i=0 ; i<NR_TASKS ; i++)
 		if (task[i] && task[i]->father == current->pid) {
 			task[i]->father = 1;
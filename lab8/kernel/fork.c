@@ -36,10 +36,18 @@ void verify_area(void * addr,int size)
 	}
 }
 
+/*
+ * The new task gets a page directory of its own, with the kernel part
+ * copied from pg_dir. Its user space is at TASK_BASE like everybody
+ * else's, so the number of tasks isn't limited by the linear address
+ * space any more.
+ */
 int copy_mem(int nr,struct task_struct * p)
 {
 	unsigned long old_data_base,new_data_base,data_limit;
 	unsigned long old_code_base,new_code_base,code_limit;
+	unsigned long * dir;
+	int i;
 
 	code_limit=get_limit(0x0f);
 	data_limit=get_limit(0x17);
@@ -49,13 +57,19 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
-	new_data_base = new_code_base = nr * 0x4000000;
+	if (!(dir = (unsigned long *) get_free_page()))
+		return -ENOMEM;
+	for (i=0 ; i<KERNEL_PGD_ENTRIES ; i++)
+		dir[i] = pg_dir[i];
+	p->tss.cr3 = (long) dir;
+	new_data_base = new_code_base = TASK_BASE;
 	p->start_code = new_code_base;
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
+	if (copy_page_tables(old_data_base,new_data_base,data_limit,p)) {
 		printk("free_page_tables: from copy_mem\n");
-		free_page_tables(new_data_base,data_limit);
+		free_page_tables(new_data_base,data_limit,p);
+		free_page((long) dir);
 		return -ENOMEM;
 	}
 	return 0;
@@ -122,6 +136,14 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 		free_page((long) p);
 		return -EAGAIN;
 	}
+	if (copy_mmap(p)) {
+		free_page_tables(get_base(p->ldt[1]),get_limit(0x0f),p);
+		free_page_tables(get_base(p->ldt[2]),get_limit(0x17),p);
+		free_page(p->tss.cr3);
+		task[nr] = NULL;
+		free_page((long) p);
+		return -EAGAIN;
+	}
 	for (i=0; i<NR_OPEN;i++)
 		if ((f=p->filp[i]))
 			f->f_count++;
@@ -168,7 +168,8 @@ int sys_times(struct tms * tbuf)
 int sys_brk(unsigned long end_data_seg)
 {
 	if (end_data_seg >= current->end_code &&
-	    end_data_seg < current->start_stack - 16384)
+	    end_data_seg < current->start_stack - 16384 &&
+	    end_data_seg <= mmap_base())
 		current->brk = end_data_seg;
 	return current->brk;
 }
@@ -218,12 +219,10 @@ int sys_uname(struct utsname * name)
 	static struct utsname thisname = {
 		"linux .0","nodename","release ","version ","machine "
 	};
-	int i;
 
 	if (!name) return -ERROR;
 	verify_area(name,sizeof *name);
-	for(i=0;i<sizeof *name;i++)
-		put_fs_byte(((char *) &thisname)[i],i+(char *) name);
+	copy_to_user((char *) name,(char *) &thisname,sizeof *name);
 	return 0;
 }
 
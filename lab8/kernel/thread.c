@@ -65,6 +65,7 @@ int init_tss(int eax,long ebp,long edi,long esi,long gs,long none,
 	p->start_time = jiffies;
 	p->tid = current->tid_num;
 	p->tid_num = 1;
+	p->mmap = NULL;		/* the main thread's mappings are used */
 	/*tid_num only make effects in Main thread*/
 	current->tid_num += 1;
 	p->tss.back_link = 0;
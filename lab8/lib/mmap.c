@@ -0,0 +1,27 @@
+#define __LIBRARY__
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * mmap has six arguments, more than fit into the registers, so the
+ * kernel gets a pointer to them.
+ */
+#define __NR_mmap_args __NR_mmap
+
+static inline _syscall1(long,mmap_args,unsigned long *,args)
+
+void * mmap(void * addr, size_t len, int prot, int flags, int fd, off_t off)
+{
+	unsigned long args[6];
+
+	args[0] = (unsigned long) addr;
+	args[1] = len;
+	args[2] = prot;
+	args[3] = flags;
+	args[4] = fd;
+	args[5] = off;
+	return (void *) mmap_args(args);
+}
+
+_syscall2(int,munmap,void *,addr,size_t,len)
+_syscall3(int,msync,void *,addr,size_t,len,int,flags)
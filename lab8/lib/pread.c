@@ -0,0 +1,34 @@
+#define __LIBRARY__
+#include <unistd.h>
+
+/*
+ * pread and pwrite have four arguments, one more than fits into the
+ * registers, so the kernel gets a pointer to them.
+ */
+#define __NR_pread_args __NR_pread
+#define __NR_pwrite_args __NR_pwrite
+
+static inline _syscall1(int,pread_args,unsigned long *,args)
+static inline _syscall1(int,pwrite_args,unsigned long *,args)
+
+int pread(int fildes, void * buf, size_t count, off_t offset)
+{
+	unsigned long args[4];
+
+	args[0] = fildes;
+	args[1] = (unsigned long) buf;
+	args[2] = count;
+	args[3] = offset;
+	return pread_args(args);
+}
+
+int pwrite(int fildes, const void * buf, size_t count, off_t offset)
+{
+	unsigned long args[4];
+
+	args[0] = fildes;
+	args[1] = (unsigned long) buf;
+	args[2] = count;
+	args[3] = offset;
+	return pwrite_args(args);
+}
@@ -0,0 +1,6 @@
+#define __LIBRARY__
+#include <unistd.h>
+#include <sys/uio.h>
+
+_syscall3(int,readv,int,fildes,const struct iovec *,iov,int,iovcnt)
+_syscall3(int,writev,int,fildes,const struct iovec *,iov,int,iovcnt)
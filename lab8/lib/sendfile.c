@@ -0,0 +1,37 @@
+#define __LIBRARY__
+#include <unistd.h>
+
+/*
+ * sendfile and copy_file_range have more arguments than fit into the
+ * registers, so the kernel gets a pointer to them.
+ */
+#define __NR_sendfile_args __NR_sendfile
+#define __NR_copy_file_range_args __NR_copy_file_range
+
+static inline _syscall1(int,sendfile_args,unsigned long *,args)
+static inline _syscall1(int,copy_file_range_args,unsigned long *,args)
+
+int sendfile(int out_fd, int in_fd, off_t * offset, size_t count)
+{
+	unsigned long args[4];
+
+	args[0] = out_fd;
+	args[1] = in_fd;
+	args[2] = (unsigned long) offset;
+	args[3] = count;
+	return sendfile_args(args);
+}
+
+int copy_file_range(int fd_in, off_t * off_in, int fd_out, off_t * off_out,
+	size_t len, unsigned int flags)
+{
+	unsigned long args[6];
+
+	args[0] = fd_in;
+	args[1] = (unsigned long) off_in;
+	args[2] = fd_out;
+	args[3] = (unsigned long) off_out;
+	args[4] = len;
+	args[5] = flags;
+	return copy_file_range_args(args);
+}
@@ -0,0 +1,445 @@
+/*
+ *  linux/mm/filemap.c
+ */
+
+/*
+ * The page cache. File data is cached in whole pages of free memory,
+ * found through a hash on (device, inode number, offset). The buffer
+ * cache is only used for meta-data (super blocks, bitmaps, inodes,
+ * directories and indirect blocks), and for the block devices.
+ *
+ * A cached page holds one reference in mem_map. Pages that nobody else
+ * is using are given back by shrink_page_cache() when get_free_page()
+ * runs out, so the cache grows into all otherwise unused memory.
+ *
+ * Dirty pages keep a pointer to their inode, which is only safe as long
+ * as the inode is in use: iput() writes them out before letting go of
+ * the last reference.
+ */
+
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+
+#define NR_PAGE_HASH 1021
+#define SHRINK_BATCH 16
+#define MAX_DIRTY_PAGES (paging_pages/8)
+#define MIN_RA_PAGES 2
+#define MAX_RA_PAGES 16
+
+struct page * page_map = NULL;
+static struct page * page_hash [ NR_PAGE_HASH ] = {NULL,};
+static int nr_dirty_pages = 0;
+
+#define _hashfn(dev,ino,offset) \
+	(((unsigned)((dev)^(ino)^((offset)>>12)))%NR_PAGE_HASH)
+#define hash(dev,ino,offset) page_hash[_hashfn(dev,ino,offset)]
+
+static inline void wait_on_page(struct page * p)
+{
+	cli();
+	while (p->p_flags & PG_locked)
+		sleep_on(&p->p_wait);
+	sti();
+}
+
+static inline void unlock_page(struct page * p)
+{
+	p->p_flags &= ~PG_locked;
+	wake_up(&p->p_wait);
+}
+
+static struct page * find_page(int dev, int ino, unsigned long offset)
+{
+	struct page * p;
+
+	for (p = hash(dev,ino,offset) ; p ; p = p->p_next)
+		if (p->p_dev == dev && p->p_ino == ino && p->p_offset == offset)
+			return p;
+	return NULL;
+}
+
+static void add_page(struct page * p, int dev, int ino, unsigned long offset)
+{
+	p->p_dev = dev;
+	p->p_ino = ino;
+	p->p_offset = offset;
+	p->p_next = hash(dev,ino,offset);
+	hash(dev,ino,offset) = p;
+	mem_map[p - page_map]++;
+}
+
+static void clear_page_dirty(struct page * p)
+{
+	if (!(p->p_flags & PG_dirty))
+		return;
+	p->p_flags &= ~PG_dirty;
+	p->p_inode->i_dirty_pages--;
+	p->p_inode = NULL;
+	nr_dirty_pages--;
+}
+
+/*
+ * Takes a page out of the page cache, and drops the cache's reference.
+ * Anybody still mapping it keeps it as an ordinary page.
+ */
+static void remove_page(struct page * p)
+{
+	struct page ** q;
+
+	for (q = &hash(p->p_dev,p->p_ino,p->p_offset) ; *q ; q = &(*q)->p_next)
+		if (*q == p) {
+			*q = p->p_next;
+			break;
+		}
+	clear_page_dirty(p);
+	p->p_dev = 0;
+	p->p_flags = 0;
+	p->p_next = NULL;
+	free_page(PAGE_ADDR(p));
+}
+
+static void page_blocks(struct m_inode * inode, unsigned long offset, int nr[4])
+{
+	int block,i;
+
+	block = offset >> BLOCK_SIZE_BITS;
+	for (i=0 ; i<4 ; i++,block++)
+		nr[i] = (block*BLOCK_SIZE < inode->i_size) ? bmap(inode,block) : 0;
+}
+
+/*
+ * Finishes a read into a locked page: anything past the end of the file
+ * reads as zero. Returns 0 (and drops the page) if the read failed.
+ */
+static int end_page_read(struct page * p, struct m_inode * inode, int ok)
+{
+	int i;
+
+	if (ok) {
+		i = p->p_offset + PAGE_SIZE - inode->i_size;
+		if (i > 0 && i < PAGE_SIZE)
+			memset((char *) PAGE_ADDR(p) + PAGE_SIZE - i,0,i);
+		p->p_flags |= PG_uptodate;
+	}
+	unlock_page(p);
+	if (!ok && p->p_dev)
+		remove_page(p);
+	return ok;
+}
+
+int page_cached(struct m_inode * inode, unsigned long offset)
+{
+	return find_page(inode->i_dev,inode->i_num,offset & ~(PAGE_SIZE-1))
+		!= NULL;
+}
+
+/*
+ * Returns the page cache page holding "offset" (page aligned) of the
+ * file, reading it in if necessary, with an extra reference for the
+ * caller to free_page(). Returns 0 if out of memory or on read errors.
+ * Anything past the end of the file reads as zero.
+ */
+unsigned long read_cache_page(struct m_inode * inode, unsigned long offset)
+{
+	struct page * p;
+	unsigned long page;
+	int nr[4];
+
+	if ((p = find_page(inode->i_dev,inode->i_num,offset))) {
+		page = PAGE_ADDR(p);
+		mem_map[MAP_NR(page)]++;
+		p->p_flags |= PG_referenced;
+		wait_on_page(p);
+		if (p->p_flags & PG_uptodate)
+			return page;
+		free_page(page);
+		return 0;
+	}
+	if (!(page = get_free_page()))
+		return 0;
+	p = PAGE_STRUCT(page);
+	p->p_flags = PG_locked | PG_referenced;
+	add_page(p,inode->i_dev,inode->i_num,offset);
+	page_blocks(inode,offset,nr);
+	if (end_page_read(p,inode,brw_page(READ,page,inode->i_dev,nr)))
+		return page;
+	free_page(page);
+	return 0;
+}
+
+/*
+ * Reads up to "nr" pages from "offset" on into the page cache. The reads
+ * for all of them are started before waiting for any, so the driver gets
+ * them all at once, in order. Pages that are cached already are skipped,
+ * and running out of memory just means reading less.
+ */
+static void read_cache_pages(struct m_inode * inode, unsigned long offset,
+	int nr)
+{
+	struct page * pages[MAX_RA_PAGES];
+	struct buffer_head * tmp;
+	struct page * p;
+	unsigned long page;
+	int b[4];
+	int i,n=0;
+
+	if (nr > MAX_RA_PAGES)
+		nr = MAX_RA_PAGES;
+	if (!(tmp = (struct buffer_head *) get_free_page()))
+		return;
+	for (i=0 ; i<nr && offset < inode->i_size ; i++,offset += PAGE_SIZE) {
+		if (find_page(inode->i_dev,inode->i_num,offset))
+			continue;
+		if (!(page = get_free_page()))
+			break;
+		p = PAGE_STRUCT(page);
+		p->p_flags = PG_locked;
+		add_page(p,inode->i_dev,inode->i_num,offset);
+		page_blocks(inode,offset,b);
+		brw_page_start(READ,tmp+4*n,page,inode->i_dev,b);
+		pages[n++] = p;
+	}
+	for (i=0 ; i<n ; i++) {
+		end_page_read(pages[i],inode,brw_page_wait(tmp+4*i));
+		free_page(PAGE_ADDR(pages[i]));
+	}
+	free_page((unsigned long) tmp);
+}
+
+/*
+ * Page faults that walk through a file in order (demand-loading an
+ * executable, touching a mapping) open up a readahead window on the
+ * inode, which doubles on every fault that lands past the previous one
+ * but inside its window. Any other fault shrinks it back. Returns the
+ * end of the window, so that the caller can map the pages up to there
+ * right away.
+ */
+unsigned long fault_readahead(struct m_inode * inode, unsigned long offset)
+{
+	offset &= ~(PAGE_SIZE-1);
+	if (offset > inode->i_ra_prev && offset <= inode->i_ra_end) {
+		if ((inode->i_ra_pages <<= 1) > MAX_RA_PAGES)
+			inode->i_ra_pages = MAX_RA_PAGES;
+	} else
+		inode->i_ra_pages = MIN_RA_PAGES;
+	read_cache_pages(inode,offset,inode->i_ra_pages);
+	inode->i_ra_prev = offset;
+	inode->i_ra_end = offset + inode->i_ra_pages*PAGE_SIZE;
+	return inode->i_ra_end;
+}
+
+/*
+ * Copies "count" bytes at "offset" in the file to kernel memory through
+ * the page cache. Used for demand-loading executables, which are not
+ * page aligned in the file as the header comes first.
+ */
+void read_cache_data(struct m_inode * inode, unsigned long offset,
+	char * buf, int count)
+{
+	unsigned long page;
+	int chars;
+
+	while (count > 0) {
+		chars = PAGE_SIZE - (offset & (PAGE_SIZE-1));
+		if (chars > count)
+			chars = count;
+		if (offset < inode->i_size &&
+		    (page = read_cache_page(inode,offset & ~(PAGE_SIZE-1)))) {
+			memcpy(buf,(char *) page + (offset & (PAGE_SIZE-1)),chars);
+			free_page(page);
+		} else
+			memset(buf,0,chars);
+		buf += chars;
+		offset += chars;
+		count -= chars;
+	}
+}
+
+void mark_page_dirty(unsigned long page, struct m_inode * inode)
+{
+	struct page * p = PAGE_STRUCT(page);
+
+	if (!p->p_dev || (p->p_flags & PG_dirty))
+		return;
+	p->p_flags |= PG_dirty;
+	p->p_inode = inode;
+	p->p_dirtied = jiffies;
+	inode->i_dirty_pages++;
+	nr_dirty_pages++;
+}
+
+/*
+ * Writes out a dirty page. The page and the inode are held across the
+ * I/O, in case somebody truncates or closes the file meanwhile.
+ */
+static void write_page(struct page * p)
+{
+	struct m_inode * inode = p->p_inode;
+	unsigned long page = PAGE_ADDR(p);
+	int nr[4];
+	int block,i;
+
+	p->p_flags |= PG_locked;
+	inode->i_count++;
+	mem_map[MAP_NR(page)]++;
+	clear_page_dirty(p);
+	block = p->p_offset >> BLOCK_SIZE_BITS;
+	for (i=0 ; i<4 ; i++,block++)
+		nr[i] = (block*BLOCK_SIZE < inode->i_size) ?
+			create_block(inode,block) : 0;
+	brw_page(WRITE,page,inode->i_dev,nr);
+	unlock_page(p);
+	free_page(page);
+	iput(inode);
+}
+
+void write_cache_page(unsigned long page)
+{
+	struct page * p = PAGE_STRUCT(page);
+
+	wait_on_page(p);
+	if (p->p_flags & PG_dirty)
+		write_page(p);
+}
+
+void write_inode_pages(struct m_inode * inode)
+{
+	struct page * p;
+
+	for (p = page_map ; inode->i_dirty_pages && p < page_map+paging_pages ; p++) {
+		if (!(p->p_flags & PG_dirty) || p->p_inode != inode)
+			continue;
+		wait_on_page(p);
+		if ((p->p_flags & PG_dirty) && p->p_inode == inode)
+			write_page(p);
+	}
+}
+
+void sync_pages(int dev)
+{
+	struct page * p;
+
+	for (p = page_map ; nr_dirty_pages && p < page_map+paging_pages ; p++) {
+		if (!(p->p_flags & PG_dirty) || (dev && p->p_dev != dev))
+			continue;
+		wait_on_page(p);
+		if ((p->p_flags & PG_dirty) && (!dev || p->p_dev == dev))
+			write_page(p);
+	}
+}
+
+/*
+ * Writes up to nr pages that have been dirty for at least age ticks,
+ * for the flusher. The scan goes on where the last one stopped, so all
+ * of memory gets its turn. Returns the number of pages written.
+ */
+int write_dirty_pages(int nr, long age)
+{
+	static int next = 0;
+	struct page * p;
+	int i, n = 0;
+
+	for (i = 0 ; nr_dirty_pages && n < nr && i < paging_pages ; i++) {
+		if (next >= paging_pages)
+			next = 0;
+		p = page_map + next++;
+		if (!(p->p_flags & PG_dirty) || jiffies - p->p_dirtied < age)
+			continue;
+		wait_on_page(p);
+		if ((p->p_flags & PG_dirty) && jiffies - p->p_dirtied >= age) {
+			write_page(p);
+			n++;
+		}
+	}
+	return n;
+}
+
+/*
+ * Dirty pages can't be given back under memory pressure, so writers
+ * call this to keep them to a reasonable part of memory.
+ */
+void balance_dirty_pages(void)
+{
+	if (nr_dirty_pages > MAX_DIRTY_PAGES)
+		sync_pages(0);
+}
+
+/*
+ * Drops all cached pages of a file, dirty or not. Called by truncate()
+ * before the blocks are freed.
+ */
+void invalidate_inode_pages(struct m_inode * inode)
+{
+	struct page * p;
+
+	for (p = page_map ; p < page_map+paging_pages ; p++) {
+		if (p->p_dev != inode->i_dev || p->p_ino != inode->i_num)
+			continue;
+		wait_on_page(p);
+		if (p->p_dev == inode->i_dev && p->p_ino == inode->i_num)
+			remove_page(p);
+	}
+}
+
+/*
+ * Drops all cached pages of a device, used when a floppy is changed.
+ */
+void invalidate_pages(int dev)
+{
+	struct page * p;
+
+	for (p = page_map ; p < page_map+paging_pages ; p++) {
+		if (p->p_dev != dev)
+			continue;
+		wait_on_page(p);
+		if (p->p_dev == dev)
+			remove_page(p);
+	}
+}
+
+/*
+ * Called by get_free_page() when memory has run out: gives back up to
+ * SHRINK_BATCH clean pages that only the cache is using. This is a
+ * simple clock: pages used since the hand last passed get a second
+ * chance. Never sleeps.
+ */
+int shrink_page_cache(void)
+{
+	static int hand = 0;
+	struct page * p;
+	int count = 2*paging_pages;
+	int freed = 0;
+
+	while (count-- > 0 && freed < SHRINK_BATCH) {
+		if (++hand >= paging_pages)
+			hand = 0;
+		p = page_map + hand;
+		if (!p->p_dev || (p->p_flags & (PG_locked | PG_dirty)))
+			continue;
+		if (mem_map[hand] != 1)
+			continue;
+		if (p->p_flags & PG_referenced) {
+			p->p_flags &= ~PG_referenced;
+			continue;
+		}
+		remove_page(p);
+		freed++;
+	}
+	return freed;
+}
+
+/*
+ * page_map has one entry for every page in mem_map, so it is allocated
+ * at boot, right after it. Returns the new start of free memory.
+ */
+unsigned long page_cache_init(unsigned long start_mem)
+{
+	start_mem = (start_mem + 3) & ~3;
+	page_map = (struct page *) start_mem;
+	start_mem += paging_pages * sizeof(struct page);
+	memset(page_map,0,paging_pages * sizeof(struct page));
+	return start_mem;
+}
@@ -36,16 +36,6 @@ static inline volatile void oom(void)
 	do_exit(SIGSEGV);
 }
 
-#define invalidate() \
-__asm__("movl %%eax,%%cr3"::"a" (0))
-
-/* these are not to be changed without changing head.s etc */
-#define LOW_MEM 0x100000
-#define PAGING_MEMORY (15*1024*1024)
-#define PAGING_PAGES (PAGING_MEMORY>>12)
-#define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
-#define USED 100
-
 #define CODE_SPACE(addr) ((((addr)+4095)&~4095) < \
 current->start_code + current->end_code)
 
@@ -54,13 +44,14 @@ static long HIGH_MEMORY = 0;
 #define copy_page(from,to) \
 __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024))
 
-static unsigned char mem_map [ PAGING_PAGES ] = {0,};
+unsigned long paging_pages = 0;
+unsigned char * mem_map = NULL;
 
 /*
  * Get physical address of first (actually last :-) free page, and mark it
  * used. If no free pages left, return 0.
  */
-unsigned long get_free_page(void)
+static unsigned long find_free_page(void)
 {
 register unsigned long __res asm("ax");
 
@@ -76,12 +67,26 @@ __asm__("std ; repne ; scasb\n\t"
 	"movl %%edx,%%eax\n"
 	"1:"
 	:"=a" (__res)
-	:"0" (0),"i" (LOW_MEM),"c" (PAGING_PAGES),
-	"D" (mem_map+PAGING_PAGES-1)
+	:"0" (0),"i" (LOW_MEM),"c" (paging_pages),
+	"D" (mem_map+paging_pages-1)
 	);
 return __res;
 }
 
+/*
+ * Free memory is used by the page cache, so when we run out we first
+ * try to get some back from there.
+ */
+unsigned long get_free_page(void)
+{
+	unsigned long page;
+
+	while (!(page = find_free_page()))
+		if (!shrink_page_cache())
+			return 0;
+	return page;
+}
+
 /*
  * Free a page of memory at physical address 'addr'. Used by
  * 'free_page_tables()'
@@ -99,20 +104,22 @@ void free_page(unsigned long addr)
 }
 
 /*
- * This function frees a continuos block of page tables, as needed
- * by 'exit()'. As does copy_page_tables(), this handles only 4Mb blocks.
+ * This function frees a continuos block of page tables in the page
+ * directory of task "p", as needed by 'exit()'. As does copy_page_tables(),
+ * this handles only 4Mb blocks.
  */
-int free_page_tables(unsigned long from,unsigned long size)
+int free_page_tables(unsigned long from,unsigned long size,
+	struct task_struct * p)
 {
 	unsigned long *pg_table;
 	unsigned long * dir, nr;
 
 	if (from & 0x3fffff)
 		panic("free_page_tables called with wrong alignment");
-	if (!from)
+	if (from < TASK_BASE)
 		panic("Trying to free up swapper memory space");
 	size = (size + 0x3fffff) >> 22;
-	dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
+	dir = pgd_entry(p,from);
 	for ( ; size-->0 ; dir++) {
 		if (!(1 & *dir))
 			continue;
@@ -146,8 +153,11 @@ int free_page_tables(unsigned long from,unsigned long size)
  * doesn't take any more memory - we don't copy-on-write in the low
  * 1 Mb-range, so the pages can be shared with the kernel. Thus the
  * special case for nr=xxxx.
+ *
+ * The copy goes into the page directory of the new task "p".
  */
-int copy_page_tables(unsigned long from,unsigned long to,long size)
+int copy_page_tables(unsigned long from,unsigned long to,long size,
+	struct task_struct * p)
 {
 	unsigned long * from_page_table;
 	unsigned long * to_page_table;
@@ -157,8 +167,8 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 
 	if ((from&0x3fffff) || (to&0x3fffff))
 		panic("copy_page_tables called with wrong alignment");
-	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	to_dir = (unsigned long *) ((to>>20) & 0xffc);
+	from_dir = pgd_entry(current,from);
+	to_dir = pgd_entry(p,to);
 	size = ((unsigned) (size+0x3fffff)) >> 22;
 	for( ; size-->0 ; from_dir++,to_dir++) {
 		if (1 & *to_dir)
@@ -196,15 +206,23 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
  */
 unsigned long put_page(unsigned long page,unsigned long address)
 {
-	unsigned long tmp, *page_table;
-
-/* NOTE !!! This uses the fact that _pg_dir=0 */
-
 	if (page < LOW_MEM || page >= HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n",page,address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
+	return map_page(page,address,7);
+}
+
+/*
+ * map_page() is put_page() for pages that may also be used elsewhere
+ * (page cache pages), with the page bits given by "prot".
+ */
+unsigned long map_page(unsigned long page,unsigned long address,
+	unsigned long prot)
+{
+	unsigned long tmp, *page_table;
+
+	page_table = pgd_entry(current,address);
 	if ((*page_table)&1)
 		page_table = (unsigned long *) (0xfffff000 & *page_table);
 	else {
@@ -213,7 +231,7 @@ unsigned long put_page(unsigned long page,unsigned long address)
 		*page_table = tmp|7;
 		page_table = (unsigned long *) tmp;
 	}
-	page_table[(address>>12) & 0x3ff] = page | 7;
+	page_table[(address>>12) & 0x3ff] = page | prot;
 /* no need for invalidate */
 	return page;
 }
@@ -246,29 +264,39 @@ void un_wp_page(unsigned long * table_entry)
  */
 void do_wp_page(unsigned long error_code,unsigned long address)
 {
+	unsigned long * table_entry;
+	struct vm_area_struct * vma;
+
 #if 0
 /* we cannot do this yet: the estdio library writes to code space */
 /* stupid, stupid. I really want the libc.a from GNU */
 	if (CODE_SPACE(address))
 		do_exit(SIGSEGV);
 #endif
-	un_wp_page((unsigned long *)
+	table_entry = (unsigned long *)
 		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
-
+		*pgd_entry(current,address)));
+	vma = find_vma(address - current->start_code);
+	if (vma && do_mmap_wp_page(vma,table_entry))
+		return;
+	un_wp_page(table_entry);
 }
 
 void write_verify(unsigned long address)
 {
 	unsigned long page;
+	struct vm_area_struct * vma;
 
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
+	if (!( (page = *pgd_entry(current,address)) &1))
 		return;
 	page &= 0xfffff000;
 	page += ((address>>10) & 0xffc);
-	if ((3 & *(unsigned long *) page) == 1)  /* non-writeable, present */
-		un_wp_page((unsigned long *) page);
-	return;
+	if ((3 & *(unsigned long *) page) != 1)  /* non-writeable, present */
+		return;
+	vma = find_vma(address - current->start_code);
+	if (vma && do_mmap_wp_page(vma,(unsigned long *) page))
+		return;
+	un_wp_page((unsigned long *) page);
 }
 
 void get_empty_page(unsigned long address)
@@ -297,9 +325,8 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 	unsigned long to_page;
 	unsigned long phys_addr;
 
-	from_page = to_page = ((address>>20) & 0xffc);
-	from_page += ((p->start_code>>20) & 0xffc);
-	to_page += ((current->start_code>>20) & 0xffc);
+	from_page = (unsigned long) pgd_entry(p,p->start_code + address);
+	to_page = (unsigned long) pgd_entry(current,current->start_code + address);
 /* is there a page-directory at from? */
 	from = *(unsigned long *) from_page;
 	if (!(from & 1))
@@ -363,46 +390,121 @@ static int share_page(unsigned long address)
 	return 0;
 }
 
-void do_no_page(unsigned long error_code,unsigned long address)
+static int page_present(unsigned long address)
+{
+	unsigned long page;
+
+	page = *pgd_entry(current,address);
+	if (!(page & 1))
+		return 0;
+	return 1 & ((unsigned long *) (page & 0xfffff000))[(address>>12) & 0x3ff];
+}
+
+/*
+ * Reads page "tmp" of the data space from the executable, through the
+ * page cache. Returns 0 if out of memory.
+ */
+static int exec_page(unsigned long tmp)
 {
-	int nr[4];
-	unsigned long tmp;
 	unsigned long page;
-	int block,i;
+	int i;
+
+	if (!(page = get_free_page()))
+		return 0;
+/* remember that 1 block is used for header */
+	read_cache_data(current->executable,tmp+BLOCK_SIZE,(char *) page,
+		PAGE_SIZE);
+	i = tmp + 4096 - current->end_data;
+	tmp += current->start_code;
+	while (i-- > 0)
+		((char *) page)[4095-i] = 0;
+	if (put_page(page,tmp))
+		return 1;
+	free_page(page);
+	return 0;
+}
+
+void do_no_page(unsigned long error_code,unsigned long address)
+{
+	unsigned long tmp,end;
+	struct vm_area_struct * vma;
 
 	address &= 0xfffff000;
 	tmp = address - current->start_code;
+	if ((vma = find_vma(tmp))) {
+		if (!do_mmap_page(vma,tmp))
+			oom();
+		return;
+	}
 	if (!current->executable || tmp >= current->end_data) {
 		get_empty_page(address);
 		return;
 	}
 	if (share_page(tmp))
 		return;
-	if (!(page = get_free_page()))
+	end = fault_readahead(current->executable,tmp+BLOCK_SIZE) - BLOCK_SIZE;
+	if (!exec_page(tmp))
 		oom();
-/* remember that 1 block is used for header */
-	block = 1 + tmp/BLOCK_SIZE;
-	for (i=0 ; i<4 ; block++,i++)
-		nr[i] = bmap(current->executable,block);
-	bread_page(page,current->executable->i_dev,nr);
-	i = tmp + 4096 - current->end_data;
-	tmp = page + 4096;
-	while (i-- > 0) {
-		tmp--;
-		*(char *)tmp = 0;
+/*
+ * Fault-around: the readahead window is in the page cache now, so the
+ * following pages are cheap to load while we're at it.
+ */
+	while ((tmp += PAGE_SIZE) < current->end_data && tmp + PAGE_SIZE <= end) {
+		if (page_present(current->start_code + tmp))
+			continue;
+		if (!share_page(tmp) && !exec_page(tmp))
+			break;
 	}
-	if (put_page(page,address))
-		return;
-	free_page(page);
-	oom();
 }
 
+/*
+ * What mem_init() takes from the start of main memory: the page tables
+ * for memory above 16MB, mem_map and page_map.
+ */
+long mem_init_size(long end_mem)
+{
+	long pages = (end_mem - LOW_MEM) >> 12;
+	long size = 0;
+
+	if (end_mem > 16*1024*1024)
+		size = ((end_mem - 16*1024*1024 + 0x3fffff) >> 22) << 12;
+	size += pages + 3 + pages * sizeof (struct page);
+	return (size + 4095) & ~4095;
+}
+
+/*
+ * head.s only maps the first 16MB. The rest of memory is mapped here,
+ * with page tables taken from the start of main memory. main() keeps
+ * that and the mem_init_size() bytes after it below 16MB, so we can
+ * write to them. As this happens before the first fork, every page
+ * directory gets the new entries.
+ *
+ * mem_map and page_map are then put right after the page tables.
+ */
 void mem_init(long start_mem, long end_mem)
 {
+	unsigned long * pg_table = NULL;
+	unsigned long addr;
 	int i;
 
+	for (addr = 16*1024*1024 ; addr < end_mem ; addr += PAGE_SIZE) {
+		if (!(addr & 0x3fffff)) {
+			pg_table = (unsigned long *) start_mem;
+			start_mem += PAGE_SIZE;
+			for (i=0 ; i<1024 ; i++)
+				pg_table[i] = 0;
+			pg_dir[addr>>22] = 7 + (unsigned long) pg_table;
+		}
+		pg_table[(addr>>12) & 0x3ff] = 7 + addr;
+	}
+	invalidate();
 	HIGH_MEMORY = end_mem;
-	for (i=0 ; i<PAGING_PAGES ; i++)
+	paging_pages = (end_mem - LOW_MEM) >> 12;
+	mem_map = (unsigned char *) start_mem;
+	start_mem += paging_pages;
+	start_mem = page_cache_init(start_mem);
+	start_mem = (start_mem + 4095) & ~4095;
+	for (i=0 ; i<paging_pages ; i++)
 		mem_map[i] = USED;
 	i = MAP_NR(start_mem);
 	end_mem -= start_mem;
@@ -415,13 +517,14 @@ void calc_mem(void)
 {
 	int i,j,k,free=0;
 	long * pg_tbl;
+	unsigned long * dir = (unsigned long *) current->tss.cr3;
 
-	for(i=0 ; i<PAGING_PAGES ; i++)
+	for(i=0 ; i<paging_pages ; i++)
 		if (!mem_map[i]) free++;
-	printk("%d pages free (of %d)\n\r",free,PAGING_PAGES);
-	for(i=2 ; i<1024 ; i++) {
-		if (1&pg_dir[i]) {
-			pg_tbl=(long *) (0xfffff000 & pg_dir[i]);
+	printk("%d pages free (of %d)\n\r",free,paging_pages);
+	for(i=KERNEL_PGD_ENTRIES ; i<1024 ; i++) {
+		if (1&dir[i]) {
+			pg_tbl=(long *) (0xfffff000 & dir[i]);
 			for(j=k=0 ; j<1024 ; j++)
 				if (pg_tbl[j]&1)
 					k++;
@@ -0,0 +1,395 @@
+/*
+ *  linux/mm/mmap.c
+ */
+
+/*
+ * mmap() of regular files. A mapping is just a vm_area_struct on the
+ * task's list: nothing is read at mmap() time, do_no_page() calls
+ * do_mmap_page() to bring in a page when it is first touched, exactly
+ * like demand-loading of executables.
+ *
+ * Mappings use the page cache pages directly, so they see the same data
+ * as read() and write(). Shared mappings are never copied on write, and
+ * their dirty pages are handed back to the page cache by msync(),
+ * munmap(), exec() and exit(). Private mappings get their own copy of
+ * a page on the first write.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+
+volatile void do_exit(long code);
+
+/*
+ * Threads share the address space of their main thread, and so also
+ * its list of mappings. Their own mmap pointer is always NULL.
+ */
+static struct task_struct * mm_owner(void)
+{
+	struct task_struct ** p;
+
+	if (!current->tid)
+		return current;
+	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p)
+		if (*p && (*p)->pid == current->pid && !(*p)->tid)
+			return *p;
+	return current;
+}
+
+/*
+ * Returns the page table entry for "address" (relative to the data
+ * space) or NULL if there is no page table for it.
+ */
+static unsigned long * get_pte(unsigned long address)
+{
+	unsigned long page;
+
+	address += current->start_code;
+	page = *pgd_entry(current,address);
+	if (!(page & 1))
+		return NULL;
+	return (unsigned long *) ((page & 0xfffff000) + ((address>>10) & 0xffc));
+}
+
+struct vm_area_struct * find_vma(unsigned long address)
+{
+	struct vm_area_struct * vma;
+
+	for (vma = mm_owner()->mmap ; vma ; vma = vma->vm_next)
+		if (address < vma->vm_end)
+			return (address >= vma->vm_start) ? vma : NULL;
+	return NULL;
+}
+
+/*
+ * The lowest mapped address: sys_brk() may not grow the data segment
+ * past this.
+ */
+unsigned long mmap_base(void)
+{
+	struct vm_area_struct * vma;
+
+	if ((vma = mm_owner()->mmap))
+		return vma->vm_start;
+	return MMAP_TOP;
+}
+
+/*
+ * Called by do_no_page() for a missing page inside a mapping. Returns
+ * 0 if out of memory.
+ *
+ * The page cache page itself is mapped: shared mappings get it writable,
+ * private ones read-only, so that the first write copies it. The rest of
+ * the readahead window is mapped as well, as long as it is in the mapping.
+ */
+int do_mmap_page(struct vm_area_struct * vma, unsigned long address)
+{
+	struct m_inode * inode = vma->vm_inode;
+	unsigned long offset,page,prot,end;
+	unsigned long * pte;
+
+	if (!(vma->vm_prot & (PROT_READ | PROT_WRITE | PROT_EXEC)))
+		do_exit(SIGSEGV);
+	offset = vma->vm_offset + address - vma->vm_start;
+	if (offset >= inode->i_size)
+		do_exit(SIGSEGV);
+	end = fault_readahead(inode,offset);
+	prot = 5;
+	if ((vma->vm_flags & MAP_SHARED) && (vma->vm_prot & PROT_WRITE))
+		prot = 7;
+	if (!(page = read_cache_page(inode,offset)))
+		return 0;
+	if (!map_page(page,current->start_code + address,prot)) {
+		free_page(page);
+		return 0;
+	}
+	while ((address += PAGE_SIZE) < vma->vm_end) {
+		offset += PAGE_SIZE;
+		if (offset >= end || offset >= inode->i_size)
+			break;
+		if ((pte = get_pte(address)) && (*pte & 1))
+			continue;
+		if (!(page = read_cache_page(inode,offset)))
+			break;
+		if (!map_page(page,current->start_code + address,prot)) {
+			free_page(page);
+			break;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Called on a write to a present, write-protected page inside a mapping.
+ * Returns 1 if it has been dealt with, 0 if the page should just be
+ * copied as usual (private mappings).
+ */
+int do_mmap_wp_page(struct vm_area_struct * vma, unsigned long * table_entry)
+{
+	if (!(vma->vm_prot & PROT_WRITE))
+		do_exit(SIGSEGV);
+	if (!(vma->vm_flags & MAP_SHARED))
+		return 0;
+	*table_entry |= 2;
+	invalidate();
+	return 1;
+}
+
+/*
+ * Drops the pages in [start,end) of a mapping. Dirty shared pages are
+ * marked dirty in the page cache, to be written back with the rest of
+ * the file. The page tables themselves are left alone.
+ */
+static void unmap_pages(struct vm_area_struct * vma,
+	unsigned long start, unsigned long end)
+{
+	unsigned long * pte;
+	unsigned long page;
+
+	for ( ; start < end ; start += PAGE_SIZE) {
+		if (!(pte = get_pte(start)) || !(*pte & 1))
+			continue;
+		page = *pte;
+		*pte = 0;
+		invalidate();
+		if ((vma->vm_flags & MAP_SHARED) && (page & 0x40))
+			mark_page_dirty(page & 0xfffff000,vma->vm_inode);
+		free_page(page & 0xfffff000);
+	}
+}
+
+static int do_munmap(unsigned long addr, unsigned long len)
+{
+	struct vm_area_struct ** p;
+	struct vm_area_struct * vma, * tail;
+	unsigned long end = addr + len;
+
+	p = &mm_owner()->mmap;
+	while ((vma = *p)) {
+		if (vma->vm_end <= addr || vma->vm_start >= end) {
+			p = &vma->vm_next;
+			continue;
+		}
+		if (vma->vm_start < addr && vma->vm_end > end) {
+/* punching a hole: split the area in two */
+			if (!(tail = malloc(sizeof(*tail))))
+				return -ENOMEM;
+			*tail = *vma;
+			tail->vm_start = end;
+			tail->vm_offset += end - vma->vm_start;
+			vma->vm_next = tail;
+			vma->vm_end = addr;
+			vma->vm_inode->i_count++;
+			unmap_pages(vma,addr,end);
+			return 0;
+		}
+		if (vma->vm_start < addr) {
+			unmap_pages(vma,addr,vma->vm_end);
+			vma->vm_end = addr;
+			p = &vma->vm_next;
+			continue;
+		}
+		if (vma->vm_end > end) {
+			unmap_pages(vma,vma->vm_start,end);
+			vma->vm_offset += end - vma->vm_start;
+			vma->vm_start = end;
+			return 0;
+		}
+		*p = vma->vm_next;
+		unmap_pages(vma,vma->vm_start,vma->vm_end);
+		iput(vma->vm_inode);
+		free_s(vma,sizeof(*vma));
+	}
+	return 0;
+}
+
+/*
+ * Finds a hole of "len" bytes, searching downwards from MMAP_TOP so that
+ * the heap has as much room as possible. Returns 0 if there is none.
+ */
+static unsigned long get_unmapped_area(unsigned long len)
+{
+	struct vm_area_struct * vma;
+	unsigned long addr;
+
+	addr = MMAP_TOP - len;
+repeat:
+	for (vma = mm_owner()->mmap ; vma ; vma = vma->vm_next)
+		if (addr < vma->vm_end && addr + len > vma->vm_start) {
+			if (vma->vm_start < len)
+				return 0;
+			addr = vma->vm_start - len;
+			goto repeat;
+		}
+	if (addr < PAGE_ALIGN(current->brk))
+		return 0;
+	return addr;
+}
+
+/*
+ * The system call interface only passes 3 arguments, so mmap() gets a
+ * pointer to its 6 arguments: addr, len, prot, flags, fd and offset.
+ */
+int sys_mmap(unsigned long * buffer)
+{
+	unsigned long addr,len,prot,flags,fd,off;
+	struct file * file;
+	struct m_inode * inode;
+	struct vm_area_struct ** p;
+	struct vm_area_struct * vma;
+	int error;
+
+	addr = get_fs_long(buffer);
+	len = get_fs_long(buffer+1);
+	prot = get_fs_long(buffer+2);
+	flags = get_fs_long(buffer+3);
+	fd = get_fs_long(buffer+4);
+	off = get_fs_long(buffer+5);
+	if (fd >= NR_OPEN || !(file = current->filp[fd]))
+		return -EBADF;
+	inode = file->f_inode;
+	if (!inode || !S_ISREG(inode->i_mode))
+		return -ENODEV;
+	len = PAGE_ALIGN(len);
+	if (!len || len > MMAP_TOP || (off & (PAGE_SIZE-1)))
+		return -EINVAL;
+	if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))
+		return -EINVAL;
+	switch (flags & MAP_TYPE) {
+		case MAP_SHARED:
+			if ((prot & PROT_WRITE) &&
+			    (file->f_flags & O_ACCMODE) != O_RDWR)
+				return -EACCES;
+		case MAP_PRIVATE:
+			if ((file->f_flags & O_ACCMODE) == O_WRONLY)
+				return -EACCES;
+			break;
+		default:
+			return -EINVAL;
+	}
+	if (flags & MAP_FIXED) {
+		if ((addr & (PAGE_SIZE-1)) || addr < PAGE_ALIGN(current->brk) ||
+		    addr + len > MMAP_TOP || addr + len < addr)
+			return -EINVAL;
+		if ((error = do_munmap(addr,len)))
+			return error;
+	} else if (!(addr = get_unmapped_area(len)))
+		return -ENOMEM;
+	if (!(vma = malloc(sizeof(*vma))))
+		return -ENOMEM;
+	vma->vm_start = addr;
+	vma->vm_end = addr + len;
+	vma->vm_prot = prot;
+	vma->vm_flags = flags & MAP_TYPE;
+	vma->vm_inode = inode;
+	vma->vm_offset = off;
+	inode->i_count++;
+	for (p = &mm_owner()->mmap ; *p ; p = &(*p)->vm_next)
+		if ((*p)->vm_start > addr)
+			break;
+	vma->vm_next = *p;
+	*p = vma;
+	return addr;
+}
+
+int sys_munmap(unsigned long addr, unsigned long len)
+{
+	len = PAGE_ALIGN(len);
+	if ((addr & (PAGE_SIZE-1)) || !len || addr + len < addr)
+		return -EINVAL;
+	return do_munmap(addr,len);
+}
+
+/*
+ * MS_ASYNC only marks the pages dirty in the page cache, MS_SYNC also
+ * writes them out. MS_INVALIDATE drops the pages from the mapping, so
+ * that the next access looks them up again.
+ */
+int sys_msync(unsigned long addr, unsigned long len, int flags)
+{
+	struct vm_area_struct * vma;
+	unsigned long start,end;
+	unsigned long * pte;
+
+	len = PAGE_ALIGN(len);
+	if ((addr & (PAGE_SIZE-1)) || addr + len < addr)
+		return -EINVAL;
+	if (flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE))
+		return -EINVAL;
+	if ((flags & MS_ASYNC) && (flags & MS_SYNC))
+		return -EINVAL;
+	for (vma = mm_owner()->mmap ; vma ; vma = vma->vm_next) {
+		if (vma->vm_end <= addr || vma->vm_start >= addr + len)
+			continue;
+		start = (vma->vm_start > addr) ? vma->vm_start : addr;
+		end = (vma->vm_end < addr + len) ? vma->vm_end : addr + len;
+		if (flags & MS_INVALIDATE) {
+			unmap_pages(vma,start,end);
+			continue;
+		}
+		if (!(vma->vm_flags & MAP_SHARED))
+			continue;
+		for ( ; start < end ; start += PAGE_SIZE) {
+			if (!(pte = get_pte(start)) || (*pte & 0x41) != 0x41)
+				continue;
+			*pte &= ~0x40;
+			invalidate();
+			mark_page_dirty(*pte & 0xfffff000,vma->vm_inode);
+			if (flags & MS_SYNC)
+				write_cache_page(*pte & 0xfffff000);
+		}
+	}
+	return 0;
+}
+
+/*
+ * fork() gives the child its own copy of the list: the pages themselves
+ * have already been shared by copy_page_tables().
+ */
+int copy_mmap(struct task_struct * p)
+{
+	struct vm_area_struct ** to;
+	struct vm_area_struct * from, * vma;
+
+	p->mmap = NULL;
+	to = &p->mmap;
+	for (from = mm_owner()->mmap ; from ; from = from->vm_next) {
+		if (!(vma = malloc(sizeof(*vma)))) {
+			while ((vma = p->mmap)) {
+				p->mmap = vma->vm_next;
+				iput(vma->vm_inode);
+				free_s(vma,sizeof(*vma));
+			}
+			return -ENOMEM;
+		}
+		*vma = *from;
+		vma->vm_next = NULL;
+		vma->vm_inode->i_count++;
+		*to = vma;
+		to = &vma->vm_next;
+	}
+	return 0;
+}
+
+/*
+ * Called by exec() and exit() before the page tables are freed.
+ */
+void exit_mmap(void)
+{
+	struct task_struct * owner = mm_owner();
+	struct vm_area_struct * vma;
+
+	while ((vma = owner->mmap)) {
+		owner->mmap = vma->vm_next;
+		unmap_pages(vma,vma->vm_start,vma->vm_end);
+		iput(vma->vm_inode);
+		free_s(vma,sizeof(*vma));
+	}
+}